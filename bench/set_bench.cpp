@@ -0,0 +1,697 @@
+#include "arena_allocator.h"
+#include "btree_set.h"
+#include "concurrent_set.h"
+#include "flat_set.h"
+#include "frozen_set.h"
+#include "parallel_set.h"
+#include "set.h"
+#include "thread_pool.h"
+
+#include <benchmark/benchmark.h>
+#include <malloc.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Heap accounting: the global operator new counts allocations and tracks the live bytes
+namespace {
+
+struct heap_counters {
+  std::atomic<std::size_t> allocations{0};
+  std::atomic<std::size_t> live{0};
+  std::atomic<std::size_t> peak{0};
+};
+
+heap_counters heap;
+
+void* note_allocation(void* p) {
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  heap.allocations.fetch_add(1, std::memory_order_relaxed);
+  std::size_t live = heap.live.fetch_add(malloc_usable_size(p), std::memory_order_relaxed) + malloc_usable_size(p);
+  std::size_t peak = heap.peak.load(std::memory_order_relaxed);
+  while (live > peak && !heap.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+  }
+  return p;
+}
+
+void note_free(void* p) noexcept {
+  if (p) {
+    heap.live.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+    std::free(p);
+  }
+}
+
+} // namespace
+
+void* operator new(std::size_t bytes) {
+  return note_allocation(std::malloc(bytes ? bytes : 1));
+}
+
+void* operator new(std::size_t bytes, std::align_val_t align) {
+  std::size_t a = static_cast<std::size_t>(align);
+  return note_allocation(std::aligned_alloc(a, (std::max<std::size_t>(bytes, 1) + a - 1) / a * a));
+}
+
+void operator delete(void* p) noexcept {
+  note_free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  note_free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+  note_free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+  note_free(p);
+}
+
+namespace {
+
+// Allocations and extra peak heap of the timed parts, reported per iteration
+class heap_window {
+  std::size_t allocations_{0};
+  std::size_t peak_{0};
+  std::size_t start_allocations_{0};
+  std::size_t start_live_{0};
+
+public:
+  void begin() noexcept {
+    start_allocations_ = heap.allocations.load(std::memory_order_relaxed);
+    start_live_ = heap.live.load(std::memory_order_relaxed);
+    heap.peak.store(start_live_, std::memory_order_relaxed);
+  }
+
+  void end() noexcept {
+    allocations_ += heap.allocations.load(std::memory_order_relaxed) - start_allocations_;
+    peak_ = std::max(peak_, heap.peak.load(std::memory_order_relaxed) - start_live_);
+  }
+
+  void report(benchmark::State& state) const {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    state.counters["allocs"] = benchmark::Counter(static_cast<double>(allocations_), benchmark::Counter::kAvgIterations);
+    state.counters["peak_heap"] = benchmark::Counter(static_cast<double>(peak_), benchmark::Counter::kDefaults,
+                                                     benchmark::Counter::OneK::kIs1024);
+    // Of the whole process so far, ru_maxrss is in kilobytes
+    state.counters["max_rss"] = benchmark::Counter(static_cast<double>(usage.ru_maxrss) * 1024,
+                                                   benchmark::Counter::kDefaults, benchmark::Counter::OneK::kIs1024);
+  }
+};
+
+enum class key_order { sorted, reversed, random, zigzag };
+
+const char* order_name(key_order order) {
+  switch (order) {
+  case key_order::sorted:
+    return "sorted";
+  case key_order::reversed:
+    return "reversed";
+  case key_order::random:
+    return "random";
+  case key_order::zigzag:
+    return "zigzag";
+  }
+  return "";
+}
+
+// 0, 2, ..., 2(n - 1) in the given order. zigzag alternates between the ends, 0, 2(n - 1), 2, ...,
+// so every new key lands between the two previous ones: a path for an unbalanced tree and a
+// steady stream of rotations for a balanced one.
+std::vector<int> make_keys(key_order order, std::size_t n) {
+  std::vector<int> keys(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    keys[i] = static_cast<int>(2 * i);
+  }
+  switch (order) {
+  case key_order::sorted:
+    break;
+  case key_order::reversed:
+    std::reverse(keys.begin(), keys.end());
+    break;
+  case key_order::random:
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(n));
+    break;
+  case key_order::zigzag:
+    for (std::size_t i = 0, lo = 0, hi = n; i < n; ++i) {
+      keys[i] = static_cast<int>(2 * (i % 2 == 0 ? lo++ : --hi));
+    }
+    break;
+  }
+  return keys;
+}
+
+std::vector<int> shuffled(std::vector<int> keys, std::uint64_t seed) {
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(seed));
+  return keys;
+}
+
+template <typename C>
+struct is_flat : std::false_type {};
+
+template <typename... Args>
+struct is_flat<flat_set<Args...>> : std::true_type {};
+
+template <typename C>
+struct is_frozen : std::false_type {};
+
+template <typename... Args>
+struct is_frozen<frozen_set<Args...>> : std::true_type {};
+
+// A flat_set is built in one sort, n insertions into it are quadratic,
+// and a frozen_set is a snapshot of one
+template <typename C>
+C build(const std::vector<int>& keys) {
+  if constexpr (is_frozen<C>::value) {
+    return freeze(build<flat_set<int>>(keys));
+  } else {
+    C c;
+    if constexpr (is_flat<C>::value) {
+      c.build_from(keys);
+    } else {
+      for (int k : keys) {
+        c.insert(k);
+      }
+    }
+    return c;
+  }
+}
+
+template <typename C>
+void bench_insert(benchmark::State& state, key_order order) {
+  std::vector<int> keys = make_keys(order, state.range(0));
+  heap_window window;
+  for (auto _ : state) {
+    window.begin();
+    {
+      C c;
+      for (int k : keys) {
+        c.insert(k);
+      }
+      benchmark::DoNotOptimize(c.size());
+      window.end();
+      state.PauseTiming();
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  window.report(state);
+}
+
+template <typename C>
+void bench_erase(benchmark::State& state, key_order order) {
+  std::vector<int> keys = make_keys(order, state.range(0));
+  std::vector<int> erased = shuffled(keys, 1);
+  heap_window window;
+  for (auto _ : state) {
+    state.PauseTiming();
+    C c = build<C>(keys);
+    state.ResumeTiming();
+    window.begin();
+    for (int k : erased) {
+      c.erase(k);
+    }
+    window.end();
+    benchmark::DoNotOptimize(c.size());
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  window.report(state);
+}
+
+template <typename C>
+void bench_find(benchmark::State& state, key_order order) {
+  std::vector<int> keys = make_keys(order, state.range(0));
+  C c = build<C>(keys);
+  std::vector<int> queries = shuffled(keys, 2);
+  heap_window window;
+  window.begin();
+  for (auto _ : state) {
+    for (int q : queries) {
+      benchmark::DoNotOptimize(c.find(q) != c.end());
+    }
+  }
+  window.end();
+  state.SetItemsProcessed(state.iterations() * queries.size());
+  window.report(state);
+}
+
+// Every query misses, so the search always runs down to a leaf
+template <typename C>
+void bench_lower_bound(benchmark::State& state, key_order order) {
+  std::vector<int> keys = make_keys(order, state.range(0));
+  C c = build<C>(keys);
+  std::vector<int> queries = shuffled(keys, 3);
+  for (int& q : queries) {
+    ++q;
+  }
+  heap_window window;
+  window.begin();
+  for (auto _ : state) {
+    for (int q : queries) {
+      benchmark::DoNotOptimize(c.lower_bound(q) != c.end());
+    }
+  }
+  window.end();
+  state.SetItemsProcessed(state.iterations() * queries.size());
+  window.report(state);
+}
+
+template <typename C>
+void bench_iterate(benchmark::State& state, key_order order) {
+  C c = build<C>(make_keys(order, state.range(0)));
+  heap_window window;
+  window.begin();
+  for (auto _ : state) {
+    long sum = 0;
+    for (auto it = c.begin(); it != c.end(); ++it) {
+      sum += *it;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  window.end();
+  state.SetItemsProcessed(state.iterations() * c.size());
+  window.report(state);
+}
+
+template <typename C>
+void bench_copy(benchmark::State& state, key_order order) {
+  C c = build<C>(make_keys(order, state.range(0)));
+  heap_window window;
+  for (auto _ : state) {
+    window.begin();
+    {
+      C copy(c);
+      benchmark::DoNotOptimize(copy.size());
+      window.end();
+      state.PauseTiming();
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * c.size());
+  window.report(state);
+}
+
+template <typename C>
+void bench_clear(benchmark::State& state, key_order order) {
+  std::vector<int> keys = make_keys(order, state.range(0));
+  heap_window window;
+  for (auto _ : state) {
+    state.PauseTiming();
+    C c = build<C>(keys);
+    state.ResumeTiming();
+    window.begin();
+    c.clear();
+    window.end();
+    benchmark::DoNotOptimize(c.size());
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  window.report(state);
+}
+
+// Reloading a set from its serialized form against rebuilding it by insertion, see load/insert
+void bench_load(benchmark::State& state) {
+  std::stringstream stored(std::ios::in | std::ios::out | std::ios::binary);
+  build<set<int>>(make_keys(key_order::random, state.range(0))).serialize(stored);
+  std::string bytes = stored.str();
+  heap_window window;
+  for (auto _ : state) {
+    std::istringstream in(bytes, std::ios::binary);
+    window.begin();
+    set<int> loaded;
+    loaded.deserialize(in);
+    window.end();
+    benchmark::DoNotOptimize(loaded.size());
+    state.PauseTiming();
+    {
+      set<int> dropped(std::move(loaded));
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  window.report(state);
+}
+
+// One lookup at a time against contains_many on the same keys
+template <typename C>
+void bench_contains(benchmark::State& state) {
+  C c = build<C>(make_keys(key_order::random, state.range(0)));
+  std::vector<int> queries = shuffled(make_keys(key_order::sorted, 2 * state.range(0)), 4);
+  for (auto _ : state) {
+    std::size_t found = 0;
+    for (int q : queries) {
+      found += c.contains(q);
+    }
+    benchmark::DoNotOptimize(found);
+  }
+  state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+template <typename C>
+void bench_contains_many(benchmark::State& state) {
+  C c = build<C>(make_keys(key_order::random, state.range(0)));
+  std::vector<int> queries = shuffled(make_keys(key_order::sorted, 2 * state.range(0)), 4);
+  std::unique_ptr<bool[]> found(new bool[queries.size()]);
+  for (auto _ : state) {
+    c.contains_many(queries.data(), queries.size(), found.get());
+    benchmark::DoNotOptimize(found.get());
+  }
+  state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+// The parallel set operations with state.range(1) threads; 1 thread runs the sequential operation
+void bench_parallel_copy(benchmark::State& state) {
+  set<int> c = build<set<int>>(make_keys(key_order::random, state.range(0)));
+  std::size_t threads = state.range(1);
+  thread_pool pool(threads);
+  for (auto _ : state) {
+    set<int> copy = threads == 1 ? set<int>(c) : parallel_copy(c, pool, threads);
+    benchmark::DoNotOptimize(copy.size());
+    state.PauseTiming();
+    copy.clear();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * c.size());
+}
+
+// Even and odd keys, so every element of both sets stays in the union
+void bench_parallel_merge(benchmark::State& state) {
+  std::vector<int> keys = make_keys(key_order::random, state.range(0));
+  std::vector<int> odd = keys;
+  for (int& k : odd) {
+    ++k;
+  }
+  std::size_t threads = state.range(1);
+  thread_pool pool(threads);
+  for (auto _ : state) {
+    state.PauseTiming();
+    set<int> target = build<set<int>>(keys);
+    set<int> source = build<set<int>>(odd);
+    state.ResumeTiming();
+    if (threads == 1) {
+      target.merge(source);
+    } else {
+      parallel_merge(target, source, pool, threads);
+    }
+    benchmark::DoNotOptimize(target.size());
+    state.PauseTiming();
+    target.clear();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * 2 * keys.size());
+}
+
+// Every other key of the set is in the other one
+void bench_parallel_intersect(benchmark::State& state) {
+  std::vector<int> keys = make_keys(key_order::random, state.range(0));
+  set<int> other;
+  for (int k : keys) {
+    other.insert(k % 4 == 0 ? k : k + 1);
+  }
+  std::size_t threads = state.range(1);
+  thread_pool pool(threads);
+  for (auto _ : state) {
+    state.PauseTiming();
+    set<int> s = build<set<int>>(keys);
+    state.ResumeTiming();
+    if (threads == 1) {
+      s.intersect(other);
+    } else {
+      parallel_intersect(s, other, pool, threads);
+    }
+    benchmark::DoNotOptimize(s.size());
+    state.PauseTiming();
+    s.clear();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// Only the caller's part: clear() against handing the nodes to a reclaimer thread.
+// With checked iterators the caller still walks the nodes to invalidate them.
+template <typename C>
+void bench_destroy_later(benchmark::State& state) {
+  std::vector<int> keys = make_keys(key_order::random, state.range(0));
+  thread_pool reclaimer(1);
+  for (auto _ : state) {
+    state.PauseTiming();
+    C s = build<C>(keys);
+    state.ResumeTiming();
+    if (state.range(1) == 0) {
+      s.clear();
+    } else {
+      destroy_later(s, reclaimer);
+    }
+    benchmark::DoNotOptimize(s.size());
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// Many short-lived sets of a few elements: each is built, searched once per element and destroyed
+template <typename C>
+void bench_small_sets(benchmark::State& state) {
+  std::vector<int> keys = make_keys(key_order::random, state.range(0));
+  for (auto _ : state) {
+    C s;
+    for (int k : keys) {
+      s.insert(k);
+    }
+    for (int k : keys) {
+      benchmark::DoNotOptimize(s.find(k));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// Readers of a shared concurrent_set, optionally with a writer inserting and erasing odd keys
+using shared_set_type = concurrent_set<int>;
+
+std::unique_ptr<shared_set_type> shared_set;
+std::atomic<bool> writer_stop{false};
+std::thread writer;
+
+void concurrent_setup(const benchmark::State& state) {
+  std::vector<int> keys = make_keys(key_order::sorted, state.range(0));
+  shared_set = std::make_unique<shared_set_type>(shared_set_type::set_type(sorted_unique, keys.begin(), keys.end()));
+  if (state.range(1)) {
+    writer_stop = false;
+    writer = std::thread([n = state.range(0)] {
+      std::mt19937_64 rng(5);
+      while (!writer_stop.load(std::memory_order_relaxed)) {
+        int k = static_cast<int>(2 * (rng() % n) + 1);
+        if (rng() % 2) {
+          shared_set->insert(k);
+        } else {
+          shared_set->erase(k);
+        }
+      }
+    });
+  }
+}
+
+void concurrent_teardown(const benchmark::State&) {
+  if (writer.joinable()) {
+    writer_stop = true;
+    writer.join();
+  }
+  shared_set.reset();
+}
+
+void bench_concurrent_read(benchmark::State& state) {
+  shared_set_type::reader reader = shared_set->make_reader();
+  std::uint64_t x = 0x9e3779b97f4a7c15ull * (state.thread_index() + 1);
+  std::uint64_t n = 2 * state.range(0);
+  for (auto _ : state) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    benchmark::DoNotOptimize(reader.contains(static_cast<int>(x % n)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+struct unchecked_policy : default_set_policy {
+  using iterators = unchecked_iterators;
+};
+
+struct generation_policy : default_set_policy {
+  using iterators = generation_checked_iterators;
+};
+
+struct linked_policy : default_set_policy {
+  using traversal = linked_traversal;
+};
+
+struct avl_policy : default_set_policy {
+  using balance = avl_balance;
+};
+
+struct unbalanced_policy : default_set_policy {
+  using balance = no_balance;
+};
+
+struct inline_policy : default_set_policy {
+  using storage = inline_nodes<8>;
+};
+
+template <typename Policy, typename Allocator = std::allocator<int>>
+using int_set = set<int, std::less<int>, Allocator, Policy>;
+
+struct size_range {
+  std::int64_t min;
+  std::int64_t max;
+};
+
+void apply_sizes(benchmark::internal::Benchmark* b, size_range sizes) {
+  b->RangeMultiplier(10)->Range(sizes.min, sizes.max);
+}
+
+constexpr key_order all_orders[] = {key_order::sorted, key_order::reversed, key_order::random, key_order::zigzag};
+
+template <typename C>
+void register_container(const std::string& name, size_range sizes) {
+  using bench_fn = void (*)(benchmark::State&, key_order);
+  const std::pair<const char*, bench_fn> operations[] = {
+      {"insert", bench_insert<C>}, {"erase", bench_erase<C>},     {"find", bench_find<C>},
+      {"lower_bound", bench_lower_bound<C>}, {"iterate", bench_iterate<C>}, {"copy", bench_copy<C>},
+      {"clear", bench_clear<C>},
+  };
+  for (const auto& [op, fn] : operations) {
+    for (key_order order : all_orders) {
+      std::string full = std::string(op) + "/" + order_name(order) + "/" + name;
+      apply_sizes(benchmark::RegisterBenchmark(full.c_str(), fn, order), sizes);
+    }
+  }
+}
+
+// An unbalanced tree built from sorted keys is a path, so it only gets the small sizes
+template <typename C>
+void register_balance(const std::string& name, size_range sizes, bool degenerates) {
+  for (key_order order : all_orders) {
+    size_range capped = sizes;
+    if (degenerates && order != key_order::random) {
+      capped.max = std::min<std::int64_t>(capped.max, 10000);
+      capped.min = std::min(capped.min, capped.max);
+    }
+    std::string full = std::string("balance/insert/") + order_name(order) + "/" + name;
+    apply_sizes(benchmark::RegisterBenchmark(full.c_str(), bench_insert<C>, order), capped);
+  }
+}
+
+template <typename C>
+void register_batch(const std::string& name, size_range sizes) {
+  apply_sizes(benchmark::RegisterBenchmark(("batch/contains/" + name).c_str(), bench_contains<C>), sizes);
+  apply_sizes(benchmark::RegisterBenchmark(("batch/contains_many/" + name).c_str(), bench_contains_many<C>), sizes);
+}
+
+void register_all(size_range sizes) {
+  register_container<std::set<int>>("std::set", sizes);
+  register_container<int_set<default_set_policy>>("set", sizes);
+  register_container<int_set<unchecked_policy>>("set/unchecked", sizes);
+  register_container<int_set<generation_policy>>("set/generation", sizes);
+  register_container<int_set<default_set_policy, arena_allocator<int>>>("set/arena", sizes);
+  register_container<btree_set<int>>("btree_set", sizes);
+  // Single insertions and erasures shift the array, so flat_set only gets the smaller sizes
+  size_range flat_sizes = sizes;
+  flat_sizes.max = std::min<std::int64_t>(flat_sizes.max, 100000);
+  flat_sizes.min = std::min(flat_sizes.min, flat_sizes.max);
+  register_container<flat_set<int>>("flat_set", flat_sizes);
+
+  register_balance<int_set<default_set_policy>>("red_black", sizes, false);
+  register_balance<int_set<avl_policy>>("avl", sizes, false);
+  register_balance<int_set<unbalanced_policy>>("no_balance", sizes, true);
+
+  for (key_order order : {key_order::sorted, key_order::random}) {
+    std::string suffix = std::string("/") + order_name(order);
+    apply_sizes(benchmark::RegisterBenchmark(("traversal/iterate/parent" + suffix).c_str(),
+                                             bench_iterate<int_set<default_set_policy>>, order),
+                sizes);
+    apply_sizes(benchmark::RegisterBenchmark(("traversal/iterate/linked" + suffix).c_str(),
+                                             bench_iterate<int_set<linked_policy>>, order),
+                sizes);
+  }
+
+  register_batch<int_set<default_set_policy>>("set", sizes);
+  register_batch<btree_set<int>>("btree_set", sizes);
+  register_batch<flat_set<int>>("flat_set", sizes);
+  register_batch<frozen_set<int>>("frozen_set", sizes);
+
+  apply_sizes(benchmark::RegisterBenchmark("load/deserialize", bench_load), sizes);
+  apply_sizes(benchmark::RegisterBenchmark("load/insert", bench_insert<int_set<default_set_policy>>, key_order::random),
+              sizes);
+
+  for (auto [name, fn] : {std::pair{"parallel/copy", bench_parallel_copy}, std::pair{"parallel/merge", bench_parallel_merge},
+                          std::pair{"parallel/intersect", bench_parallel_intersect}}) {
+    benchmark::RegisterBenchmark(name, fn)
+        ->ArgsProduct({{sizes.max}, {1, 2, 4, 8, 16}})
+        ->UseRealTime();
+  }
+  benchmark::RegisterBenchmark("parallel/destroy/set", bench_destroy_later<int_set<default_set_policy>>)
+      ->ArgsProduct({{sizes.max}, {0, 1}});
+  benchmark::RegisterBenchmark("parallel/destroy/set/unchecked", bench_destroy_later<int_set<unchecked_policy>>)
+      ->ArgsProduct({{sizes.max}, {0, 1}});
+
+  benchmark::RegisterBenchmark("small/set", bench_small_sets<int_set<default_set_policy>>)->RangeMultiplier(2)->Range(1, 16);
+  benchmark::RegisterBenchmark("small/set/inline", bench_small_sets<int_set<inline_policy>>)->RangeMultiplier(2)->Range(1, 16);
+
+  for (int with_writer : {0, 1}) {
+    std::string name = with_writer ? "concurrent/read/writer" : "concurrent/read/idle";
+    benchmark::RegisterBenchmark(name.c_str(), bench_concurrent_read)
+        ->Args({sizes.max, with_writer})
+        ->Setup(concurrent_setup)
+        ->Teardown(concurrent_teardown)
+        ->ThreadRange(1, 64)
+        ->UseRealTime();
+  }
+}
+
+// Takes --min_size=N and --max_size=N out of the arguments, the rest goes to Google Benchmark
+size_range parse_sizes(int& argc, char** argv) {
+  size_range sizes{100, 1000000};
+  int kept = 1;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strncmp(argv[i], "--min_size=", 11) == 0) {
+      sizes.min = std::atoll(argv[i] + 11);
+    } else if (std::strncmp(argv[i], "--max_size=", 11) == 0) {
+      sizes.max = std::atoll(argv[i] + 11);
+    } else {
+      argv[kept++] = argv[i];
+    }
+  }
+  argc = kept;
+  sizes.min = std::max<std::int64_t>(sizes.min, 1);
+  sizes.max = std::max(sizes.max, sizes.min);
+  return sizes;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  register_all(parse_sizes(argc, argv));
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
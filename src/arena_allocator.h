@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+// Block storage behind arena_allocator. Objects are bump-allocated from blocks of at
+// least BlockBytes; freed objects of the size it served first go to a free list for reuse.
+template <std::size_t BlockBytes>
+class arena_pool {
+  struct block {
+    block* next;
+  };
+
+  struct free_slot {
+    free_slot* next;
+  };
+
+  static constexpr std::size_t header_size = sizeof(std::max_align_t);
+
+  block* blocks_{nullptr};
+  char* cursor_{nullptr};
+  char* limit_{nullptr};
+  free_slot* free_{nullptr};
+  std::size_t slot_size_{0};
+
+  void add_block(std::size_t min_bytes) {
+    std::size_t bytes = std::max(BlockBytes, min_bytes + header_size);
+    block* b = static_cast<block*>(::operator new(bytes));
+    b->next = blocks_;
+    blocks_ = b;
+    cursor_ = reinterpret_cast<char*>(b) + header_size;
+    limit_ = reinterpret_cast<char*>(b) + bytes;
+  }
+
+public:
+  arena_pool() noexcept = default;
+  arena_pool(const arena_pool&) = delete;
+  arena_pool& operator=(const arena_pool&) = delete;
+
+  ~arena_pool() {
+    while (blocks_) {
+      block* next = blocks_->next;
+      ::operator delete(blocks_);
+      blocks_ = next;
+    }
+  }
+
+  void* allocate(std::size_t bytes, std::size_t align) {
+    if (slot_size_ == 0 && bytes >= sizeof(free_slot)) {
+      slot_size_ = bytes;
+    }
+    if (bytes == slot_size_ && free_) {
+      free_slot* slot = free_;
+      free_ = slot->next;
+      return slot;
+    }
+    std::size_t padding = (align - reinterpret_cast<std::uintptr_t>(cursor_) % align) % align;
+    if (!cursor_ || static_cast<std::size_t>(limit_ - cursor_) < padding + bytes) {
+      add_block(bytes);
+      padding = 0;
+    }
+    void* result = cursor_ + padding;
+    cursor_ += padding + bytes;
+    return result;
+  }
+
+  // Objects of other sizes are not reused and stay in their block until release
+  void deallocate(void* p, std::size_t bytes) noexcept {
+    if (bytes == slot_size_) {
+      free_slot* slot = static_cast<free_slot*>(p);
+      slot->next = free_;
+      free_ = slot;
+    }
+  }
+};
+
+// Allocator that carves objects out of large contiguous blocks.
+// Deallocated single objects go to a free list and are reused by later allocations,
+// blocks are returned to the system all at once by release() or when the last
+// allocator sharing the arena is destroyed.
+//
+// The arena is created lazily by the first allocate(), so a default-constructed
+// allocator (and an empty container using it) holds no memory. Copies made after that
+// share the arena and compare equal.
+template <typename T, std::size_t BlockBytes = 64 * 1024>
+class arena_allocator {
+  template <typename U, std::size_t B>
+  friend class arena_allocator;
+
+  using pool = arena_pool<BlockBytes>;
+
+  std::shared_ptr<pool> arena_;
+
+  template <typename U>
+  bool same_arena(const arena_allocator<U, BlockBytes>& other) const noexcept {
+    return arena_ == other.arena_;
+  }
+
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::false_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+  using is_always_equal = std::false_type;
+
+  template <typename U>
+  struct rebind {
+    using other = arena_allocator<U, BlockBytes>;
+  };
+
+  static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not supported");
+
+  arena_allocator() noexcept = default;
+
+  template <typename U>
+  arena_allocator(const arena_allocator<U, BlockBytes>& other) noexcept : arena_(other.arena_) {}
+
+  // A copied container gets its own arena
+  arena_allocator select_on_container_copy_construction() const noexcept {
+    return arena_allocator();
+  }
+
+  T* allocate(std::size_t n) {
+    if (!arena_) {
+      arena_ = std::make_shared<pool>();
+    }
+    return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* p, std::size_t n) noexcept {
+    arena_->deallocate(p, n * sizeof(T));
+  }
+
+  // True if no other allocator shares the arena, so release() cannot free foreign objects
+  bool unique() const noexcept {
+    return !arena_ || arena_.use_count() == 1;
+  }
+
+  // Drops this allocator's reference to the arena, freeing all blocks if it was the last one
+  void release() noexcept {
+    arena_.reset();
+  }
+
+  template <typename U>
+  friend bool operator==(const arena_allocator& lhs, const arena_allocator<U, BlockBytes>& rhs) noexcept {
+    return lhs.same_arena(rhs);
+  }
+
+  template <typename U>
+  friend bool operator!=(const arena_allocator& lhs, const arena_allocator<U, BlockBytes>& rhs) noexcept {
+    return !(lhs == rhs);
+  }
+};
@@ -0,0 +1,1203 @@
+#pragma once
+
+#include "set.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// B-tree keeping many elements per node in one array, for small trivially copyable T.
+// A lookup touches O(log_B n) nodes instead of O(log n), and the elements of a node are
+// searched in cache. Only the iterators member of Policy is used, and it must be
+// tracked_iterators or unchecked_iterators.
+//
+// Elements move between nodes when nodes split and merge, so unlike set every insertion
+// or erasure invalidates all iterators. With tracked_iterators the container keeps the list
+// of its iterators and invalidates them, using one afterwards aborts as with set.
+template <typename T, typename Compare = std::less<T>, typename Allocator = std::allocator<T>,
+          typename Policy = default_set_policy>
+class btree_set : private compare_holder<Compare> {
+  static_assert(std::is_trivially_copyable_v<T>, "btree_set moves its elements as bytes");
+
+  static constexpr bool is_tracked = std::is_same_v<typename Policy::iterators, tracked_iterators>;
+  static_assert(is_tracked || std::is_same_v<typename Policy::iterators, unchecked_iterators>,
+                "btree_set supports tracked_iterators and unchecked_iterators only");
+
+  class b_iterator;
+  struct tracked_position;
+
+  enum class node_kind : unsigned char { leaf, inner, header };
+
+  struct node_base {
+    // An inner node, or the header for the root
+    node_base* parent{nullptr};
+    // Index among the children of parent
+    std::uint16_t position{0};
+    std::uint16_t count{0};
+    node_kind kind;
+
+    explicit node_base(node_kind k) noexcept : kind(k) {}
+  };
+
+public:
+  // Elements per node, a leaf takes about 256 bytes
+  static constexpr std::size_t node_capacity =
+      std::clamp<std::size_t>((256 - sizeof(node_base)) / sizeof(T), 3, UINT16_MAX);
+
+private:
+  // Every node but the root keeps at least this many elements
+  static constexpr std::size_t min_count = node_capacity / 2;
+
+  // Inner nodes have at least two children, so no tree of size_t elements is higher
+  static constexpr std::size_t max_height = 8 * sizeof(std::size_t);
+
+  struct leaf_node : node_base {
+    alignas(T) unsigned char slots[node_capacity * sizeof(T)];
+
+    explicit leaf_node(node_kind k = node_kind::leaf) noexcept : node_base(k) {}
+
+    T* keys() noexcept {
+      return reinterpret_cast<T*>(slots);
+    }
+
+    const T* keys() const noexcept {
+      return reinterpret_cast<const T*>(slots);
+    }
+  };
+
+  struct inner_node : leaf_node {
+    leaf_node* children[node_capacity + 1];
+
+    inner_node() noexcept : leaf_node(node_kind::inner) {}
+  };
+
+  // Parent of the root and the node of end()
+  struct header_node : node_base {
+    leaf_node* root{nullptr};
+
+    header_node() noexcept : node_base(node_kind::header) {}
+  };
+
+  // Live iterators of a container, all of them are invalidated by a modification
+  struct iterator_list {
+    tracked_position* share{nullptr};
+
+    DEBUG_SET_LOCAL_ITERATORS_BEGIN
+    void add_iterator(tracked_position* it) noexcept {
+      it->prev_ = nullptr;
+      it->next_ = share;
+      if (share) {
+        share->prev_ = it;
+      }
+      share = it;
+    }
+    DEBUG_SET_LOCAL_ITERATORS_END
+
+    void remove_iterator(tracked_position* it) noexcept {
+      if (it->prev_) {
+        it->prev_->next_ = it->next_;
+      } else {
+        share = it->next_;
+      }
+      if (it->next_) {
+        it->next_->prev_ = it->prev_;
+      }
+      it->prev_ = nullptr;
+      it->next_ = nullptr;
+    }
+
+    void invalidate_iterators() noexcept {
+      for (tracked_position* it = share; it;) {
+        tracked_position* next = it->next_;
+        it->node_ = nullptr;
+        it->prev_ = nullptr;
+        it->next_ = nullptr;
+        it = next;
+      }
+      share = nullptr;
+    }
+  };
+
+  struct no_iterator_list {
+    void invalidate_iterators() noexcept {}
+  };
+
+  // A valid tracked iterator stays in the list of its container
+  struct tracked_position {
+    node_base* node_{nullptr};
+    std::size_t index_{0};
+    const btree_set* container_{nullptr};
+    tracked_position* prev_{nullptr};
+    tracked_position* next_{nullptr};
+
+    tracked_position() noexcept = default;
+
+    tracked_position(node_base* node, std::size_t index, const btree_set* container) noexcept
+        : node_(node), index_(index), container_(container) {
+      append_to_container();
+    }
+
+    tracked_position(const tracked_position& other) noexcept
+        : node_(other.node_), index_(other.index_), container_(other.container_) {
+      append_to_container();
+    }
+
+    tracked_position& operator=(const tracked_position& other) noexcept {
+      if (this != &other) {
+        remove_from_container();
+        node_ = other.node_;
+        index_ = other.index_;
+        container_ = other.container_;
+        append_to_container();
+      }
+      return *this;
+    }
+
+    ~tracked_position() {
+      remove_from_container();
+    }
+
+    bool belongs_to(const btree_set* container) const noexcept {
+      return container_ == container;
+    }
+
+    void append_to_container() noexcept {
+      if (node_) {
+        container_->iterators_.add_iterator(this);
+      }
+    }
+
+    void remove_from_container() noexcept {
+      if (node_) {
+        container_->iterators_.remove_iterator(this);
+      }
+    }
+
+    void move_to(node_base* node, std::size_t index) noexcept {
+      if (!node) {
+        remove_from_container();
+      }
+      node_ = node;
+      index_ = index;
+    }
+  };
+
+  // Trivially copyable position of an unchecked iterator
+  struct bare_position {
+    node_base* node_{nullptr};
+    std::size_t index_{0};
+
+    bare_position() noexcept = default;
+
+    bare_position(node_base* node, std::size_t index, const btree_set*) noexcept : node_(node), index_(index) {}
+
+    bool belongs_to(const btree_set*) const noexcept {
+      return true;
+    }
+
+    void move_to(node_base* node, std::size_t index) noexcept {
+      node_ = node;
+      index_ = index;
+    }
+  };
+
+  using iterator_position = std::conditional_t<is_tracked, tracked_position, bare_position>;
+
+  // Inner nodes are allocated as a few leaves, so one allocator, and one arena, serves both
+  using node_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<leaf_node>;
+  using node_traits = std::allocator_traits<node_allocator>;
+
+  static_assert(alignof(inner_node) == alignof(leaf_node));
+  static_assert(std::is_same_v<typename node_traits::pointer, leaf_node*>, "fancy pointers are not supported");
+
+  static constexpr std::size_t inner_units = (sizeof(inner_node) + sizeof(leaf_node) - 1) / sizeof(leaf_node);
+
+  static leaf_node* leftmost_leaf(node_base* n) noexcept {
+    while (n->kind == node_kind::inner) {
+      n = static_cast<inner_node*>(n)->children[0];
+    }
+    return static_cast<leaf_node*>(n);
+  }
+
+  static leaf_node* rightmost_leaf(node_base* n) noexcept {
+    while (n->kind == node_kind::inner) {
+      n = static_cast<inner_node*>(n)->children[n->count];
+    }
+    return static_cast<leaf_node*>(n);
+  }
+
+  class b_iterator : private iterator_position {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = T;
+    using reference = const T&;
+    using pointer = const T*;
+
+  private:
+    using iterator_position::belongs_to;
+    using iterator_position::index_;
+    using iterator_position::move_to;
+    using iterator_position::node_;
+
+    b_iterator(node_base* node, std::size_t index, const btree_set* container) noexcept
+        : iterator_position(node, index, container) {}
+
+    friend btree_set;
+
+    void base_assert() const {
+      assert(node_);
+    }
+
+    void end_assert() const {
+      base_assert();
+      assert(node_->kind != node_kind::header);
+    }
+
+    const T& value() const noexcept {
+      return static_cast<const leaf_node*>(node_)->keys()[index_];
+    }
+
+  public:
+    b_iterator() noexcept = default;
+
+    reference operator*() const {
+      end_assert();
+      return value();
+    }
+
+    pointer operator->() const {
+      end_assert();
+      return &value();
+    }
+
+    // O(1) amortized, O(log n) worst case
+    b_iterator& operator++() {
+      end_assert();
+      node_base* n = node_;
+      std::size_t i = index_;
+      if (n->kind == node_kind::inner) {
+        n = leftmost_leaf(static_cast<inner_node*>(n)->children[i + 1]);
+        i = 0;
+      } else if (++i == n->count) {
+        // Past the end of a leaf: the next element is the separator above the last full subtree.
+        // The root has position 0, so climbing out of it ends at index 0 of the header.
+        while (n->parent->kind != node_kind::header && n->position == n->parent->count) {
+          n = n->parent;
+        }
+        i = n->position;
+        n = n->parent;
+      }
+      move_to(n, i);
+      return *this;
+    }
+
+    b_iterator operator++(int) {
+      auto tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    // O(1) amortized, O(log n) worst case
+    b_iterator& operator--() {
+      base_assert();
+      node_base* n = node_;
+      std::size_t i = index_;
+      if (n->kind == node_kind::header) {
+        leaf_node* root = static_cast<header_node*>(n)->root;
+        n = root ? rightmost_leaf(root) : nullptr;
+        i = root ? n->count - 1 : 0;
+      } else if (n->kind == node_kind::inner) {
+        n = rightmost_leaf(static_cast<inner_node*>(n)->children[i]);
+        i = n->count - 1;
+      } else if (i > 0) {
+        --i;
+      } else {
+        while (n->parent->kind != node_kind::header && n->position == 0) {
+          n = n->parent;
+        }
+        // nullptr before the first element
+        i = n->position == 0 ? 0 : n->position - 1;
+        n = n->parent->kind == node_kind::header ? nullptr : n->parent;
+      }
+      move_to(n, i);
+      base_assert();
+      return *this;
+    }
+
+    b_iterator operator--(int) {
+      auto tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    friend bool operator==(const b_iterator& left, const b_iterator& right) {
+      if constexpr (is_tracked) {
+        assert(left.container_ == right.container_);
+        assert(left.container_);
+      }
+      return left.node_ == right.node_ && left.index_ == right.index_;
+    }
+
+    friend bool operator!=(const b_iterator& left, const b_iterator& right) {
+      return !(left == right);
+    }
+
+    friend void swap(b_iterator& left, b_iterator& right) noexcept {
+      b_iterator tmp = left;
+      left = right;
+      right = tmp;
+    }
+  };
+
+public:
+  using key_type = T;
+  using value_type = T;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using allocator_type = Allocator;
+
+  using reference = T&;
+  using const_reference = const T&;
+
+  using pointer = T*;
+  using const_pointer = const T*;
+
+  using iterator = b_iterator;
+  using const_iterator = b_iterator;
+
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+private:
+  header_node header_;
+  std::size_t size_{0};
+  node_allocator alloc_;
+  mutable std::conditional_t<is_tracked, iterator_list, no_iterator_list> iterators_;
+
+  using compare_holder<Compare>::comp;
+
+  // Nodes hold trivially copyable elements and nothing to destroy, so they are created in place
+  leaf_node* create_leaf() {
+    return ::new (static_cast<void*>(node_traits::allocate(alloc_, 1))) leaf_node();
+  }
+
+  inner_node* create_inner() {
+    return ::new (static_cast<void*>(node_traits::allocate(alloc_, inner_units))) inner_node();
+  }
+
+  void destroy_node(leaf_node* n) noexcept {
+    node_traits::deallocate(alloc_, n, n->kind == node_kind::inner ? inner_units : 1);
+  }
+
+  // The recursion depth is the height of the tree, O(log n)
+  void destroy_subtree(leaf_node* n) noexcept {
+    if (n->kind == node_kind::inner) {
+      inner_node* in = static_cast<inner_node*>(n);
+      for (std::size_t j = 0; j <= n->count; ++j) {
+        // A partially copied node has no children yet
+        if (in->children[j]) {
+          destroy_subtree(in->children[j]);
+        }
+      }
+    }
+    destroy_node(n);
+  }
+
+  // Children of a copied inner node are attached as soon as they exist, so a failed copy
+  // can be destroyed with destroy_subtree
+  leaf_node* copy_subtree(const leaf_node* from, node_base* parent, std::size_t position) {
+    leaf_node* to = from->kind == node_kind::inner ? create_inner() : create_leaf();
+    to->parent = parent;
+    to->position = static_cast<std::uint16_t>(position);
+    to->count = from->count;
+    std::memcpy(to->keys(), from->keys(), from->count * sizeof(T));
+    if (from->kind == node_kind::inner) {
+      inner_node* in = static_cast<inner_node*>(to);
+      std::fill(in->children, in->children + from->count + 1, nullptr);
+      try {
+        for (std::size_t j = 0; j <= from->count; ++j) {
+          in->children[j] = copy_subtree(static_cast<const inner_node*>(from)->children[j], to, j);
+        }
+      } catch (...) {
+        destroy_subtree(to);
+        throw;
+      }
+    }
+    return to;
+  }
+
+  static void set_child(inner_node* parent, std::size_t j, leaf_node* child) noexcept {
+    parent->children[j] = child;
+    child->parent = parent;
+    child->position = static_cast<std::uint16_t>(j);
+  }
+
+  static void renumber_children(inner_node* n, std::size_t from) noexcept {
+    for (std::size_t j = from; j <= n->count; ++j) {
+      set_child(n, j, n->children[j]);
+    }
+  }
+
+  // Elements of arithmetic T under std::less are counted without branches, which compilers
+  // turn into vector compares over the node. Other elements are found by binary search.
+  template <typename K>
+  static constexpr bool counts_branchless =
+      std::is_arithmetic_v<T> && std::is_same_v<K, T> &&
+      (std::is_same_v<Compare, std::less<T>> || std::is_same_v<Compare, std::less<>>);
+
+  // Index of the first element of n not less than key
+  template <typename K>
+  std::size_t lower_index(const leaf_node* n, const K& key) const {
+    const T* keys = n->keys();
+    if constexpr (counts_branchless<K>) {
+      std::size_t result = 0;
+      for (std::size_t j = 0; j < n->count; ++j) {
+        result += keys[j] < key;
+      }
+      return result;
+    } else {
+      std::size_t first = 0;
+      std::size_t length = n->count;
+      while (length > 0) {
+        std::size_t half = length / 2;
+        if (comp()(keys[first + half], key)) {
+          first += half + 1;
+          length -= half + 1;
+        } else {
+          length = half;
+        }
+      }
+      return first;
+    }
+  }
+
+  // Index of the first element of n greater than key
+  template <typename K>
+  std::size_t upper_index(const leaf_node* n, const K& key) const {
+    const T* keys = n->keys();
+    if constexpr (counts_branchless<K>) {
+      std::size_t result = 0;
+      for (std::size_t j = 0; j < n->count; ++j) {
+        result += !(key < keys[j]);
+      }
+      return result;
+    } else {
+      std::size_t first = 0;
+      std::size_t length = n->count;
+      while (length > 0) {
+        std::size_t half = length / 2;
+        if (!comp()(key, keys[first + half])) {
+          first += half + 1;
+          length -= half + 1;
+        } else {
+          length = half;
+        }
+      }
+      return first;
+    }
+  }
+
+  struct position {
+    node_base* node;
+    std::size_t index;
+  };
+
+  const_iterator at(position pos) const noexcept {
+    if (!pos.node) {
+      return end();
+    }
+    return const_iterator(pos.node, pos.index, this);
+  }
+
+  // The element equivalent to key, or the leaf position where it would be inserted with found false
+  template <typename K>
+  std::pair<position, bool> find_position(const K& key) const {
+    leaf_node* n = header_.root;
+    while (true) {
+      std::size_t j = lower_index(n, key);
+      if (j < n->count && !comp()(key, n->keys()[j])) {
+        return {{n, j}, true};
+      }
+      if (n->kind == node_kind::leaf) {
+        return {{n, j}, false};
+      }
+      n = static_cast<inner_node*>(n)->children[j];
+    }
+  }
+
+  template <typename K>
+  position find_node(const K& key) const {
+    if (empty()) {
+      return {nullptr, 0};
+    }
+    auto [pos, found] = find_position(key);
+    return found ? pos : position{nullptr, 0};
+  }
+
+  // The separators passed on the way down bound the subtree from above,
+  // so the last one not less than key is the answer unless the leaf has a closer one
+  template <typename K>
+  position lower_bound_position(const K& key) const {
+    position result{nullptr, 0};
+    for (leaf_node* n = header_.root; n;) {
+      std::size_t j = lower_index(n, key);
+      if (j < n->count) {
+        result = {n, j};
+      }
+      n = n->kind == node_kind::inner ? static_cast<inner_node*>(n)->children[j] : nullptr;
+    }
+    return result;
+  }
+
+  template <typename K>
+  position upper_bound_position(const K& key) const {
+    position result{nullptr, 0};
+    for (leaf_node* n = header_.root; n;) {
+      std::size_t j = upper_index(n, key);
+      if (j < n->count) {
+        result = {n, j};
+      }
+      n = n->kind == node_kind::inner ? static_cast<inner_node*>(n)->children[j] : nullptr;
+    }
+    return result;
+  }
+
+  // Lookups of a batch walking the tree side by side
+  static constexpr std::size_t probe_group = 8;
+
+  static void prefetch_node(const leaf_node* n) noexcept {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(n);
+    for (std::size_t offset = 0; offset < sizeof(leaf_node); offset += 64) {
+      prefetch_address(bytes + offset);
+    }
+  }
+
+  // Finds the lower bounds of keys in groups of probe_group as set does. A step prefetches
+  // the whole next node of a lookup, whose elements are then counted in cache.
+  // finish(i, pos) gets the lower bound of keys[i], pos.node is nullptr if there is none.
+  template <typename Finish>
+  void lower_bounds_grouped(const T* keys, std::size_t count, Finish finish) const {
+    for (std::size_t base = 0; base < count; base += probe_group) {
+      std::size_t lanes = std::min(probe_group, count - base);
+      leaf_node* current[probe_group];
+      position bound[probe_group];
+      for (std::size_t l = 0; l < lanes; ++l) {
+        current[l] = header_.root;
+        bound[l] = {nullptr, 0};
+      }
+      for (bool active = true; active;) {
+        active = false;
+        for (std::size_t l = 0; l < lanes; ++l) {
+          leaf_node* n = current[l];
+          if (!n) {
+            continue;
+          }
+          std::size_t j = lower_index(n, keys[base + l]);
+          if (j < n->count) {
+            bound[l] = {n, j};
+          }
+          n = n->kind == node_kind::inner ? static_cast<inner_node*>(n)->children[j] : nullptr;
+          current[l] = n;
+          if (n) {
+            prefetch_node(n);
+            active = true;
+          }
+        }
+      }
+      for (std::size_t l = 0; l < lanes; ++l) {
+        finish(base + l, bound[l]);
+      }
+    }
+  }
+
+  static const T& value(position pos) noexcept {
+    return static_cast<const leaf_node*>(pos.node)->keys()[pos.index];
+  }
+
+  // Puts val before index j of a node with room for it, right_child goes after val
+  static void insert_into(leaf_node* n, std::size_t j, const T& val, leaf_node* right_child) noexcept {
+    T* keys = n->keys();
+    std::memmove(keys + j + 1, keys + j, (n->count - j) * sizeof(T));
+    ::new (static_cast<void*>(keys + j)) T(val);
+    ++n->count;
+    if (n->kind == node_kind::inner) {
+      inner_node* in = static_cast<inner_node*>(n);
+      std::memmove(in->children + j + 2, in->children + j + 1, (n->count - j - 1) * sizeof(leaf_node*));
+      in->children[j + 1] = right_child;
+      renumber_children(in, j + 1);
+    }
+  }
+
+  // Inserts val before index j of leaf n. Full nodes on the way up are split in halves
+  // and their middle element moves to the parent. The nodes this needs are allocated first,
+  // so a failed allocation leaves the tree as it was.
+  position insert_at(leaf_node* n, std::size_t j, const T& val) {
+    std::size_t splits = 0;
+    node_base* top = n;
+    for (; top->kind != node_kind::header && top->count == node_capacity; top = top->parent) {
+      ++splits;
+    }
+    std::size_t needed = splits + (top->kind == node_kind::header && splits > 0 ? 1 : 0);
+    leaf_node* spare[max_height + 1];
+    std::size_t allocated = 0;
+    try {
+      for (; allocated < needed; ++allocated) {
+        spare[allocated] = allocated == 0 ? create_leaf() : create_inner();
+      }
+    } catch (...) {
+      while (allocated > 0) {
+        destroy_node(spare[--allocated]);
+      }
+      throw;
+    }
+
+    // Where val ends up: it keeps moving up while it is the middle element of a split
+    position result{nullptr, 0};
+    bool located = false;
+    T carried = val;
+    leaf_node* right_child = nullptr;
+    for (std::size_t level = 0;; ++level) {
+      if (n->count < node_capacity) {
+        insert_into(n, j, carried, right_child);
+        if (!located) {
+          result = {n, j};
+        }
+        break;
+      }
+
+      // The node with carried inserted, node_capacity + 1 elements, is split around mid
+      constexpr std::size_t total = node_capacity + 1;
+      constexpr std::size_t mid = total / 2;
+      alignas(T) unsigned char buffer[total * sizeof(T)];
+      T* all = reinterpret_cast<T*>(buffer);
+      T* keys = n->keys();
+      std::memcpy(all, keys, j * sizeof(T));
+      ::new (static_cast<void*>(all + j)) T(carried);
+      std::memcpy(all + j + 1, keys + j, (node_capacity - j) * sizeof(T));
+
+      leaf_node* sibling = spare[level];
+      std::memcpy(keys, all, mid * sizeof(T));
+      std::memcpy(sibling->keys(), all + mid + 1, (total - mid - 1) * sizeof(T));
+      n->count = mid;
+      sibling->count = total - mid - 1;
+      if (n->kind == node_kind::inner) {
+        leaf_node* children[total + 1];
+        inner_node* in = static_cast<inner_node*>(n);
+        std::memcpy(children, in->children, (j + 1) * sizeof(leaf_node*));
+        children[j + 1] = right_child;
+        std::memcpy(children + j + 2, in->children + j + 1, (node_capacity - j) * sizeof(leaf_node*));
+        inner_node* sibling_in = static_cast<inner_node*>(sibling);
+        std::memcpy(sibling_in->children, children + mid + 1, (total - mid) * sizeof(leaf_node*));
+        std::memcpy(in->children, children, (mid + 1) * sizeof(leaf_node*));
+        renumber_children(in, 0);
+        renumber_children(sibling_in, 0);
+      }
+      if (!located && j != mid) {
+        result = j < mid ? position{n, j} : position{sibling, j - mid - 1};
+        located = true;
+      }
+      carried = all[mid];
+
+      if (n->parent->kind == node_kind::header) {
+        inner_node* root = static_cast<inner_node*>(spare[level + 1]);
+        ::new (static_cast<void*>(root->keys())) T(carried);
+        root->count = 1;
+        set_child(root, 0, n);
+        set_child(root, 1, sibling);
+        root->parent = &header_;
+        root->position = 0;
+        header_.root = root;
+        if (!located) {
+          result = {root, 0};
+        }
+        break;
+      }
+      right_child = sibling;
+      j = n->position;
+      n = static_cast<inner_node*>(n->parent);
+    }
+    ++size_;
+    return result;
+  }
+
+  // The leaf slot right before the element at index of node, after the greatest element for
+  // the header. Before a separator it is the end of the last leaf of the subtree on its left.
+  position leaf_slot_before(node_base* node, std::size_t index) const noexcept {
+    if (node->kind == node_kind::leaf) {
+      return {node, index};
+    }
+    leaf_node* leaf = node->kind == node_kind::header ? rightmost_leaf(header_.root)
+                                                      : rightmost_leaf(static_cast<inner_node*>(node)->children[index]);
+    return {leaf, leaf->count};
+  }
+
+  position insert_unique(const T& val) {
+    if (empty()) {
+      leaf_node* root = create_leaf();
+      ::new (static_cast<void*>(root->keys())) T(val);
+      root->count = 1;
+      root->parent = &header_;
+      header_.root = root;
+      size_ = 1;
+      iterators_.invalidate_iterators();
+      return {root, 0};
+    }
+    auto [pos, found] = find_position(val);
+    if (found) {
+      return pos;
+    }
+    position result = insert_at(static_cast<leaf_node*>(pos.node), pos.index, val);
+    iterators_.invalidate_iterators();
+    return result;
+  }
+
+  // Moves the first element of right through the separator to the end of left
+  static void rotate_left(inner_node* parent, std::size_t separator) noexcept {
+    leaf_node* left = parent->children[separator];
+    leaf_node* right = parent->children[separator + 1];
+    ::new (static_cast<void*>(left->keys() + left->count)) T(parent->keys()[separator]);
+    parent->keys()[separator] = right->keys()[0];
+    std::memmove(right->keys(), right->keys() + 1, (right->count - 1) * sizeof(T));
+    if (left->kind == node_kind::inner) {
+      inner_node* left_in = static_cast<inner_node*>(left);
+      inner_node* right_in = static_cast<inner_node*>(right);
+      set_child(left_in, left->count + 1, right_in->children[0]);
+      std::memmove(right_in->children, right_in->children + 1, right->count * sizeof(leaf_node*));
+    }
+    ++left->count;
+    --right->count;
+    if (right->kind == node_kind::inner) {
+      renumber_children(static_cast<inner_node*>(right), 0);
+    }
+  }
+
+  // Moves the last element of left through the separator to the front of right
+  static void rotate_right(inner_node* parent, std::size_t separator) noexcept {
+    leaf_node* left = parent->children[separator];
+    leaf_node* right = parent->children[separator + 1];
+    std::memmove(right->keys() + 1, right->keys(), right->count * sizeof(T));
+    ::new (static_cast<void*>(right->keys())) T(parent->keys()[separator]);
+    parent->keys()[separator] = left->keys()[left->count - 1];
+    if (right->kind == node_kind::inner) {
+      inner_node* left_in = static_cast<inner_node*>(left);
+      inner_node* right_in = static_cast<inner_node*>(right);
+      std::memmove(right_in->children + 1, right_in->children, (right->count + 1) * sizeof(leaf_node*));
+      right_in->children[0] = left_in->children[left->count];
+    }
+    --left->count;
+    ++right->count;
+    if (right->kind == node_kind::inner) {
+      renumber_children(static_cast<inner_node*>(right), 0);
+    }
+  }
+
+  // Appends the separator and all of the right child to the left one and destroys the right one
+  void merge_children(inner_node* parent, std::size_t separator) noexcept {
+    leaf_node* left = parent->children[separator];
+    leaf_node* right = parent->children[separator + 1];
+    ::new (static_cast<void*>(left->keys() + left->count)) T(parent->keys()[separator]);
+    std::memcpy(left->keys() + left->count + 1, right->keys(), right->count * sizeof(T));
+    if (left->kind == node_kind::inner) {
+      inner_node* left_in = static_cast<inner_node*>(left);
+      inner_node* right_in = static_cast<inner_node*>(right);
+      for (std::size_t k = 0; k <= right->count; ++k) {
+        set_child(left_in, left->count + 1 + k, right_in->children[k]);
+      }
+    }
+    left->count += right->count + 1;
+
+    T* keys = parent->keys();
+    std::memmove(keys + separator, keys + separator + 1, (parent->count - separator - 1) * sizeof(T));
+    std::memmove(parent->children + separator + 1, parent->children + separator + 2,
+                 (parent->count - separator - 1) * sizeof(leaf_node*));
+    --parent->count;
+    renumber_children(parent, separator + 1);
+    destroy_node(right);
+  }
+
+  // Restores the minimum fill from n up: borrows an element from a sibling that can spare one,
+  // otherwise merges with a sibling and continues with the parent
+  void rebalance(leaf_node* n) noexcept {
+    while (true) {
+      if (n->parent->kind == node_kind::header) {
+        if (n->count == 0) {
+          leaf_node* child = n->kind == node_kind::inner ? static_cast<inner_node*>(n)->children[0] : nullptr;
+          header_.root = child;
+          if (child) {
+            child->parent = &header_;
+            child->position = 0;
+          }
+          destroy_node(n);
+        }
+        return;
+      }
+      if (n->count >= min_count) {
+        return;
+      }
+      inner_node* parent = static_cast<inner_node*>(n->parent);
+      std::size_t j = n->position;
+      if (j > 0 && parent->children[j - 1]->count > min_count) {
+        rotate_right(parent, j - 1);
+        return;
+      }
+      if (j < parent->count && parent->children[j + 1]->count > min_count) {
+        rotate_left(parent, j);
+        return;
+      }
+      merge_children(parent, j > 0 ? j - 1 : j);
+      n = parent;
+    }
+  }
+
+  // An element of an inner node is replaced by its predecessor, the greatest element of a leaf,
+  // so elements are only ever taken out of leaves
+  void erase_at(position pos) noexcept {
+    leaf_node* n = static_cast<leaf_node*>(pos.node);
+    std::size_t j = pos.index;
+    if (n->kind == node_kind::inner) {
+      leaf_node* leaf = rightmost_leaf(static_cast<inner_node*>(n)->children[j]);
+      n->keys()[j] = leaf->keys()[leaf->count - 1];
+      n = leaf;
+      j = leaf->count - 1;
+    }
+    std::memmove(n->keys() + j, n->keys() + j + 1, (n->count - j - 1) * sizeof(T));
+    --n->count;
+    --size_;
+    rebalance(n);
+    iterators_.invalidate_iterators();
+  }
+
+  void forget_nodes() noexcept {
+    header_.root = nullptr;
+    size_ = 0;
+  }
+
+public:
+  // O(1) nothrow
+  btree_set() noexcept(std::is_nothrow_default_constructible_v<Compare> &&
+                       std::is_nothrow_default_constructible_v<Allocator>) = default;
+
+  // O(1)
+  explicit btree_set(const Compare& comp, const Allocator& alloc = Allocator())
+      : compare_holder<Compare>(comp), alloc_(node_allocator(alloc)) {}
+
+  // O(1)
+  explicit btree_set(const Allocator& alloc) : alloc_(node_allocator(alloc)) {}
+
+  // O(n) strong
+  btree_set(const btree_set& other)
+      : btree_set(other, node_traits::select_on_container_copy_construction(other.alloc_)) {}
+
+  // O(n) strong
+  btree_set(const btree_set& other, const Allocator& alloc)
+      : compare_holder<Compare>(other.comp()), alloc_(node_allocator(alloc)) {
+    if (!other.empty()) {
+      header_.root = copy_subtree(other.header_.root, &header_, 0);
+      size_ = other.size_;
+    }
+  }
+
+  // O(1) nothrow, O(k) for k live tracked iterators
+  // Iterators keep pointing at their elements, now in this set, and other is left empty
+  btree_set(btree_set&& other) noexcept(std::is_nothrow_copy_constructible_v<Compare>)
+      : compare_holder<Compare>(other.comp()), alloc_(other.alloc_) {
+    swap(*this, other);
+  }
+
+  // O(n log n) strong
+  template <typename InputIt, typename = require_input_iterator<InputIt>>
+  btree_set(InputIt first, InputIt last, const Compare& comp = Compare(), const Allocator& alloc = Allocator())
+      : btree_set(comp, alloc) {
+    try {
+      insert(first, last);
+    } catch (...) {
+      clear();
+      throw;
+    }
+  }
+
+  // O(n) strong
+  btree_set& operator=(const btree_set& other) {
+    if (this == &other) {
+      return *this;
+    }
+    if constexpr (node_traits::propagate_on_container_copy_assignment::value) {
+      btree_set copy(other, other.get_allocator());
+      swap(*this, copy);
+    } else {
+      btree_set copy(other, get_allocator());
+      swap(*this, copy);
+    }
+    return *this;
+  }
+
+  // O(n) nothrow, O(n) strong when the allocators differ and do not propagate
+  // The nodes of other are taken over when allocators allow it, otherwise its elements are copied
+  btree_set& operator=(btree_set&& other) noexcept(node_traits::propagate_on_container_move_assignment::value ||
+                                                   node_traits::is_always_equal::value) {
+    if (this == &other) {
+      return *this;
+    }
+    if constexpr (node_traits::propagate_on_container_move_assignment::value ||
+                  node_traits::is_always_equal::value) {
+      clear();
+      swap(*this, other);
+    } else if (alloc_ == other.alloc_) {
+      clear();
+      swap(*this, other);
+    } else {
+      btree_set copy(other, get_allocator());
+      swap(*this, copy);
+    }
+    return *this;
+  }
+
+  // O(n) nothrow
+  ~btree_set() noexcept {
+    clear();
+  }
+
+  // O(n) nothrow
+  // The elements need no destructors, so with an allocator that supports release()
+  // the whole arena is dropped without walking the tree
+  void clear() noexcept {
+    iterators_.invalidate_iterators();
+    if (empty()) {
+      return;
+    }
+    if constexpr (supports_release<node_allocator>::value) {
+      if (alloc_.unique()) {
+        alloc_.release();
+      } else {
+        destroy_subtree(header_.root);
+      }
+    } else {
+      destroy_subtree(header_.root);
+    }
+    forget_nodes();
+  }
+
+  // O(1) nothrow
+  allocator_type get_allocator() const noexcept {
+    return allocator_type(alloc_);
+  }
+
+  // O(1) nothrow
+  size_t size() const noexcept {
+    return size_;
+  }
+
+  // O(1) nothrow
+  bool empty() const noexcept {
+    return size() == 0;
+  }
+
+  // O(log n) nothrow
+  const_iterator begin() const noexcept {
+    if (empty()) {
+      return end();
+    }
+    return const_iterator(leftmost_leaf(header_.root), 0, this);
+  }
+
+  // nothrow
+  const_iterator end() const noexcept {
+    return const_iterator(const_cast<header_node*>(&header_), 0, this);
+  }
+
+  // nothrow
+  const_reverse_iterator rbegin() const noexcept {
+    return reverse_iterator(end());
+  }
+
+  // nothrow
+  const_reverse_iterator rend() const noexcept {
+    return reverse_iterator(begin());
+  }
+
+  // O(B log_B n) strong, invalidates all iterators if val is inserted
+  std::pair<iterator, bool> insert(const T& val) {
+    std::size_t old_size = size_;
+    position pos = insert_unique(val);
+    return {at(pos), size_ != old_size};
+  }
+
+  // O(B + log_B n) strong if val goes right before hint, O(B log_B n) strong otherwise,
+  // invalidates all iterators if val is inserted. A right hint saves the search from the root:
+  // val goes into the leaf slot before hint, at the end of the last leaf for end().
+  iterator insert(const_iterator hint, const T& val) {
+    assert(hint.belongs_to(this));
+    if (empty() || !(hint == end() || comp()(val, *hint))) {
+      return insert(val).first;
+    }
+    if (hint != begin() && !comp()(*std::prev(hint), val)) {
+      return insert(val).first;
+    }
+    position slot = leaf_slot_before(hint.node_, hint.index_);
+    position result = insert_at(static_cast<leaf_node*>(slot.node), slot.index, val);
+    iterators_.invalidate_iterators();
+    return at(result);
+  }
+
+  // O(k B log_B (n + k)) basic
+  template <typename InputIt, typename = require_input_iterator<InputIt>>
+  void insert(InputIt first, InputIt last) {
+    for (; first != last; ++first) {
+      insert_unique(*first);
+    }
+  }
+
+  // O(B log_B n) strong
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    return insert(T(std::forward<Args>(args)...));
+  }
+
+  // O(B log_B n) strong
+  template <typename... Args>
+  iterator emplace_hint(const_iterator hint, Args&&... args) {
+    return insert(hint, T(std::forward<Args>(args)...));
+  }
+
+  // O(B log_B n) nothrow if Compare does not throw, invalidates all iterators.
+  // Returns the element that followed the erased one, found again after the tree has changed.
+  iterator erase(const_iterator pos) {
+    assert(pos.belongs_to(this));
+    pos.end_assert();
+    T key = pos.value();
+    erase_at({pos.node_, pos.index_});
+    return at(lower_bound_position(key));
+  }
+
+  // O(B log_B n) strong
+  size_t erase(const T& val) {
+    position pos = find_node(val);
+    if (!pos.node) {
+      return 0;
+    }
+    erase_at(pos);
+    return 1;
+  }
+
+  // O(B log_B n) strong
+  const_iterator find(const T& val) const {
+    return at(find_node(val));
+  }
+
+  // O(B log_B n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator find(const K& key) const {
+    return at(find_node(key));
+  }
+
+  // O(B log_B n) strong
+  size_t count(const T& val) const {
+    return find_node(val).node ? 1 : 0;
+  }
+
+  // O(B log_B n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  size_t count(const K& key) const {
+    return find_node(key).node ? 1 : 0;
+  }
+
+  // O(B log_B n) strong
+  bool contains(const T& val) const {
+    return find_node(val).node != nullptr;
+  }
+
+  // O(B log_B n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  bool contains(const K& key) const {
+    return find_node(key).node != nullptr;
+  }
+
+  // O(B log_B n) strong
+  const_iterator lower_bound(const T& val) const {
+    return at(lower_bound_position(val));
+  }
+
+  // O(B log_B n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator lower_bound(const K& key) const {
+    return at(lower_bound_position(key));
+  }
+
+  // O(B log_B n) strong
+  const_iterator upper_bound(const T& val) const {
+    return at(upper_bound_position(val));
+  }
+
+  // O(B log_B n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator upper_bound(const K& key) const {
+    return at(upper_bound_position(key));
+  }
+
+  // O(m B log_B n) strong for m keys
+  // found[i] tells whether keys[i] is in the set. Up to 8 lookups descend at once,
+  // so the node loads of one overlap with the searches of the others, and no iterators are made.
+  void contains_many(const T* keys, std::size_t count, bool* found) const {
+    lower_bounds_grouped(keys, count, [&](std::size_t i, position pos) {
+      found[i] = pos.node && !comp()(keys[i], value(pos));
+    });
+  }
+
+  // O(m B log_B n) strong for m keys
+  // result[i] points at the least element not less than keys[i], nullptr if there is none
+  void lower_bound_many(const T* keys, std::size_t count, const T** result) const {
+    lower_bounds_grouped(keys, count, [&](std::size_t i, position pos) {
+      result[i] = pos.node ? &value(pos) : nullptr;
+    });
+  }
+
+  // O(1)
+  key_compare key_comp() const {
+    return comp();
+  }
+
+  // O(1)
+  value_compare value_comp() const {
+    return comp();
+  }
+
+  // O(k) nothrow for k live tracked iterators, O(1) otherwise.
+  // Iterators keep pointing at their elements, now in the other set, end() iterators are invalidated.
+  friend void swap(btree_set& lhs, btree_set& rhs) noexcept {
+    using std::swap;
+    swap(lhs.header_.root, rhs.header_.root);
+    swap(lhs.size_, rhs.size_);
+    swap(lhs.comp(), rhs.comp());
+    swap(lhs.alloc_, rhs.alloc_);
+    if (lhs.header_.root) {
+      lhs.header_.root->parent = &lhs.header_;
+    }
+    if (rhs.header_.root) {
+      rhs.header_.root->parent = &rhs.header_;
+    }
+    if constexpr (is_tracked) {
+      swap(lhs.iterators_.share, rhs.iterators_.share);
+      for (btree_set* s : {&lhs, &rhs}) {
+        for (tracked_position* it = s->iterators_.share; it;) {
+          tracked_position* next = it->next_;
+          it->container_ = s;
+          // The header is not swapped, the end() of the other set means nothing here
+          if (it->node_->kind == node_kind::header) {
+            s->iterators_.remove_iterator(it);
+            it->node_ = nullptr;
+          }
+          it = next;
+        }
+      }
+    }
+  }
+};
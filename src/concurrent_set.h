@@ -0,0 +1,270 @@
+#pragma once
+
+#include "set.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+// A set shared by many reader threads and serialized writers, on the left-right scheme.
+// Two equal copies of the set are kept: readers see the front one, a writer changes the back
+// one, publishes it, waits until no reader is left on the old front and repeats the change there.
+//
+// A read takes no lock and writes only to the reader's own slot, a lookup itself writes nothing.
+// A write costs two applications of the change plus the wait for the readers already inside,
+// and the elements are stored twice.
+template <typename T, typename Compare = std::less<T>, typename Allocator = std::allocator<T>,
+          typename Policy = default_set_policy>
+class concurrent_set {
+  static_assert(!std::is_same_v<typename Policy::counters, operation_counters>,
+                "operation counters are written by lookups, which would race between readers");
+
+public:
+  using set_type = set<T, Compare, Allocator, Policy>;
+  using value_type = T;
+  using size_type = std::size_t;
+
+  // The lookups that touch neither iterators nor views, so any number of threads may run
+  // them on the same set. Pointers it hands out stay valid until the read returns.
+  class read_view {
+    const set_type* set_;
+
+    explicit read_view(const set_type* s) noexcept : set_(s) {}
+
+    friend concurrent_set;
+
+  public:
+    size_type size() const noexcept {
+      return set_->size();
+    }
+
+    bool empty() const noexcept {
+      return set_->empty();
+    }
+
+    template <typename K>
+    bool contains(const K& key) const {
+      return set_->contains(key);
+    }
+
+    void contains_many(const T* keys, std::size_t count, bool* found) const {
+      set_->contains_many(keys, count, found);
+    }
+
+    void lower_bound_many(const T* keys, std::size_t count, const T** result) const {
+      set_->lower_bound_many(keys, count, result);
+    }
+  };
+
+private:
+  // One per reader, on its own cache line: 0 when idle, else 1 + the index of the copy it reads
+  struct alignas(64) reader_slot {
+    std::atomic<unsigned> reading{0};
+    bool used{false};
+  };
+
+  set_type copies_[2];
+  std::atomic<unsigned> front_{0};
+  // Guards the writers and the slot list
+  mutable std::mutex writer_;
+  // A deque keeps the slots in place as it grows
+  mutable std::deque<reader_slot> slots_;
+
+  void wait_for_readers(unsigned index) const noexcept {
+    for (const reader_slot& slot : slots_) {
+      while (slot.reading.load(std::memory_order_seq_cst) == index + 1) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  // The back copy differs from the front one after a change failed on it, until the next write
+  bool stale_{false};
+
+  // Applies f to the copy no reader sees; if it throws, that copy is left to be rebuilt
+  template <typename F>
+  decltype(auto) change(set_type& target, F& f) {
+    try {
+      return f(target);
+    } catch (...) {
+      stale_ = true;
+      throw;
+    }
+  }
+
+  // Makes the back copy equal to the front one again after a failed change
+  void resync(unsigned front) {
+    if (stale_) {
+      copies_[1 - front] = copies_[front];
+      stale_ = false;
+    }
+  }
+
+  // Once the front is flipped the change is visible, so a failure to repeat it on the old
+  // front is not reported: that copy is rebuilt before the next change instead
+  template <typename F>
+  void publish(unsigned front, F& f) noexcept {
+    front_.store(1 - front, std::memory_order_seq_cst);
+    wait_for_readers(front);
+    try {
+      f(copies_[front]);
+    } catch (...) {
+      stale_ = true;
+    }
+  }
+
+public:
+  // O(1) nothrow
+  concurrent_set() = default;
+
+  // O(n) strong
+  explicit concurrent_set(const set_type& init) : copies_{init, init} {}
+
+  concurrent_set(const concurrent_set&) = delete;
+  concurrent_set& operator=(const concurrent_set&) = delete;
+
+  // A registered reader. Each thread uses its own, a reader is not shared between threads.
+  class reader {
+    const concurrent_set* owner_{nullptr};
+    reader_slot* slot_{nullptr};
+
+    reader(const concurrent_set* owner, reader_slot* slot) noexcept : owner_(owner), slot_(slot) {}
+
+    struct read_guard {
+      reader_slot* slot;
+
+      ~read_guard() {
+        slot->reading.store(0, std::memory_order_release);
+      }
+    };
+
+    friend concurrent_set;
+
+  public:
+    reader() noexcept = default;
+
+    reader(reader&& other) noexcept
+        : owner_(std::exchange(other.owner_, nullptr)), slot_(std::exchange(other.slot_, nullptr)) {}
+
+    reader& operator=(reader&& other) noexcept {
+      reader(std::move(other)).swap(*this);
+      return *this;
+    }
+
+    ~reader() {
+      if (slot_) {
+        std::lock_guard<std::mutex> lock(owner_->writer_);
+        slot_->used = false;
+      }
+    }
+
+    void swap(reader& other) noexcept {
+      std::swap(owner_, other.owner_);
+      std::swap(slot_, other.slot_);
+    }
+
+    // O(1) plus f, lock-free
+    // Calls f with a read_view of the current contents; writers wait for f to return
+    // before they change the copy it sees
+    template <typename F>
+    decltype(auto) read(F&& f) const {
+      assert(slot_);
+      unsigned index = owner_->front_.load(std::memory_order_seq_cst);
+      while (true) {
+        slot_->reading.store(index + 1, std::memory_order_seq_cst);
+        unsigned now = owner_->front_.load(std::memory_order_seq_cst);
+        if (now == index) {
+          break;
+        }
+        index = now;
+      }
+      read_guard guard{slot_};
+      return std::forward<F>(f)(read_view(&owner_->copies_[index]));
+    }
+
+    // O(h)
+    template <typename K>
+    bool contains(const K& key) const {
+      return read([&](read_view v) { return v.contains(key); });
+    }
+
+    // O(m h) for m keys
+    void contains_many(const T* keys, std::size_t count, bool* found) const {
+      read([&](read_view v) { v.contains_many(keys, count, found); });
+    }
+
+    // O(h)
+    // A copy of the least element not less than key
+    std::optional<T> lower_bound(const T& key) const {
+      return read([&](read_view v) -> std::optional<T> {
+        const T* result = nullptr;
+        v.lower_bound_many(&key, 1, &result);
+        return result ? std::optional<T>(*result) : std::nullopt;
+      });
+    }
+
+    // O(1)
+    size_type size() const {
+      return read([](read_view v) { return v.size(); });
+    }
+  };
+
+  // O(r) strong for r readers ever registered
+  reader make_reader() const {
+    std::lock_guard<std::mutex> lock(writer_);
+    for (reader_slot& slot : slots_) {
+      if (!slot.used) {
+        slot.used = true;
+        return reader(this, &slot);
+      }
+    }
+    reader_slot& slot = slots_.emplace_back();
+    slot.used = true;
+    return reader(this, &slot);
+  }
+
+  // O(h + r) plus the wait for the current readers, O(n) after a failed update, strong
+  bool insert(const T& value) {
+    return update([&](set_type& s) { return s.insert(value).second; });
+  }
+
+  // O(h + r) plus the wait for the current readers, O(n) after a failed update, strong
+  size_type erase(const T& value) {
+    return update([&](set_type& s) { return s.erase(value); });
+  }
+
+  // Strong: applies f to both copies, first to the one no reader sees and then to the other
+  // one, and returns the result of the first call. f must act the same on equal sets and must
+  // not keep iterators between the calls. If the first call throws, nothing is published and
+  // the exception propagates; a throw from the second call is swallowed, as the change is
+  // already visible, and the copy it failed on is rebuilt by copying before the next update.
+  // That copy is O(n) and may throw too, in which case the next update fails unchanged.
+  template <typename F>
+  auto update(F f) {
+    std::lock_guard<std::mutex> lock(writer_);
+    unsigned front = front_.load(std::memory_order_relaxed);
+    resync(front);
+    if constexpr (std::is_void_v<decltype(f(copies_[0]))>) {
+      change(copies_[1 - front], f);
+      publish(front, f);
+    } else {
+      auto result = change(copies_[1 - front], f);
+      publish(front, f);
+      return result;
+    }
+  }
+
+  // O(1) nothrow, only with no concurrent writers
+  // The contents, for a writer thread to inspect freely
+  const set_type& unsafe_get() const noexcept {
+    return copies_[front_.load(std::memory_order_relaxed)];
+  }
+};
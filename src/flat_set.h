@@ -0,0 +1,756 @@
+#pragma once
+
+#include "set.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Index of the first of the length sorted elements at first that is not less than key. The probe
+// moves by a conditional select rather than a branch, and both possible next probes are prefetched.
+template <typename T, typename K, typename Compare>
+std::size_t sorted_lower_index(const T* first, std::size_t length, const K& key, const Compare& comp) {
+  if (length == 0) {
+    return 0;
+  }
+  const T* base = first;
+  while (length > 1) {
+    std::size_t half = length / 2;
+    prefetch_address(base + half / 2);
+    prefetch_address(base + half + half / 2);
+    base = comp(base[half], key) ? base + half : base;
+    length -= half;
+  }
+  return static_cast<std::size_t>(base - first) + comp(*base, key);
+}
+
+// Index of the first of the length sorted elements at first that is greater than key
+template <typename T, typename K, typename Compare>
+std::size_t sorted_upper_index(const T* first, std::size_t length, const K& key, const Compare& comp) {
+  if (length == 0) {
+    return 0;
+  }
+  const T* base = first;
+  while (length > 1) {
+    std::size_t half = length / 2;
+    prefetch_address(base + half / 2);
+    prefetch_address(base + half + half / 2);
+    base = comp(key, base[half]) ? base : base + half;
+    length -= half;
+  }
+  return static_cast<std::size_t>(base - first) + !comp(key, *base);
+}
+
+// Set kept as one sorted array, for sets built once and queried many times. Lookups are
+// branchless binary searches over contiguous memory and the elements take no per-element links.
+// Only the iterators member of Policy is used, generation_checked_iterators act as unchecked ones.
+//
+// Inserting or erasing shifts the elements after the position and may reallocate the array,
+// so every modification invalidates all iterators, as with btree_set. With tracked_iterators
+// the container keeps the list of its iterators and invalidates them, using one afterwards aborts.
+template <typename T, typename Compare = std::less<T>, typename Allocator = std::allocator<T>,
+          typename Policy = default_set_policy>
+class flat_set : private compare_holder<Compare> {
+  static constexpr bool is_tracked = std::is_same_v<typename Policy::iterators, tracked_iterators>;
+
+  class f_iterator;
+  struct tracked_position;
+
+  // Live iterators of a container, all of them are invalidated by a modification
+  struct iterator_list {
+    tracked_position* share{nullptr};
+
+    DEBUG_SET_LOCAL_ITERATORS_BEGIN
+    void add_iterator(tracked_position* it) noexcept {
+      it->prev_ = nullptr;
+      it->next_ = share;
+      if (share) {
+        share->prev_ = it;
+      }
+      share = it;
+    }
+    DEBUG_SET_LOCAL_ITERATORS_END
+
+    void remove_iterator(tracked_position* it) noexcept {
+      if (it->prev_) {
+        it->prev_->next_ = it->next_;
+      } else {
+        share = it->next_;
+      }
+      if (it->next_) {
+        it->next_->prev_ = it->prev_;
+      }
+      it->prev_ = nullptr;
+      it->next_ = nullptr;
+    }
+
+    // Puts to into the place of from in the list
+    void replace_iterator(tracked_position* from, tracked_position* to) noexcept {
+      to->prev_ = from->prev_;
+      to->next_ = from->next_;
+      if (to->prev_) {
+        to->prev_->next_ = to;
+      } else {
+        share = to;
+      }
+      if (to->next_) {
+        to->next_->prev_ = to;
+      }
+      from->prev_ = nullptr;
+      from->next_ = nullptr;
+    }
+
+    void invalidate_iterators() noexcept {
+      for (tracked_position* it = share; it;) {
+        tracked_position* next = it->next_;
+        it->container_ = nullptr;
+        it->prev_ = nullptr;
+        it->next_ = nullptr;
+        it = next;
+      }
+      share = nullptr;
+    }
+  };
+
+  struct no_iterator_list {
+    void invalidate_iterators() noexcept {}
+  };
+
+  // A valid tracked iterator knows its container and stays in its list,
+  // an invalidated one has no container
+  struct tracked_position {
+    const T* element_{nullptr};
+    const flat_set* container_{nullptr};
+    tracked_position* prev_{nullptr};
+    tracked_position* next_{nullptr};
+
+    tracked_position() noexcept = default;
+
+    tracked_position(const T* element, const flat_set* container) noexcept
+        : element_(element), container_(container) {
+      append_to_container();
+    }
+
+    tracked_position(const tracked_position& other) noexcept
+        : element_(other.element_), container_(other.container_) {
+      append_to_container();
+    }
+
+    // Moving takes over the place of other in the list of its container and leaves other singular
+    tracked_position(tracked_position&& other) noexcept : element_(other.element_), container_(other.container_) {
+      take_place_of(other);
+    }
+
+    tracked_position& operator=(const tracked_position& other) noexcept {
+      if (this != &other) {
+        remove_from_container();
+        element_ = other.element_;
+        container_ = other.container_;
+        append_to_container();
+      }
+      return *this;
+    }
+
+    tracked_position& operator=(tracked_position&& other) noexcept {
+      if (this != &other) {
+        remove_from_container();
+        element_ = other.element_;
+        container_ = other.container_;
+        take_place_of(other);
+      }
+      return *this;
+    }
+
+    ~tracked_position() {
+      remove_from_container();
+    }
+
+    bool belongs_to(const flat_set* container) const noexcept {
+      return container_ == container;
+    }
+
+    bool valid() const noexcept {
+      return container_ != nullptr;
+    }
+
+    void append_to_container() noexcept {
+      if (container_) {
+        container_->iterators_.add_iterator(this);
+      }
+    }
+
+    void remove_from_container() noexcept {
+      if (container_) {
+        container_->iterators_.remove_iterator(this);
+      }
+    }
+
+    void take_place_of(tracked_position& other) noexcept {
+      if (container_) {
+        container_->iterators_.replace_iterator(&other, this);
+      }
+      other.container_ = nullptr;
+    }
+  };
+
+  // Trivially copyable position of an unchecked iterator
+  struct bare_position {
+    const T* element_{nullptr};
+
+    bare_position() noexcept = default;
+
+    bare_position(const T* element, const flat_set*) noexcept : element_(element) {}
+
+    bool belongs_to(const flat_set*) const noexcept {
+      return true;
+    }
+
+    bool valid() const noexcept {
+      return true;
+    }
+  };
+
+  using iterator_position = std::conditional_t<is_tracked, tracked_position, bare_position>;
+
+  class f_iterator : private iterator_position {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = T;
+    using reference = const T&;
+    using pointer = const T*;
+
+  private:
+    using iterator_position::belongs_to;
+    using iterator_position::element_;
+    using iterator_position::valid;
+
+    f_iterator(const T* element, const flat_set* container) noexcept : iterator_position(element, container) {}
+
+    friend flat_set;
+
+    void base_assert() const {
+      assert(valid());
+    }
+
+    // Unchecked iterators do not know their container, end() is only caught by tracked ones
+    void end_assert() const {
+      base_assert();
+      if constexpr (is_tracked) {
+        assert(element_ != this->container_->data_end());
+      }
+    }
+
+    void begin_assert() const {
+      base_assert();
+      if constexpr (is_tracked) {
+        assert(element_ != this->container_->elements_.data());
+      }
+    }
+
+  public:
+    f_iterator() noexcept = default;
+
+    reference operator*() const {
+      end_assert();
+      return *element_;
+    }
+
+    pointer operator->() const {
+      end_assert();
+      return element_;
+    }
+
+    // O(1)
+    f_iterator& operator++() {
+      end_assert();
+      ++element_;
+      return *this;
+    }
+
+    f_iterator operator++(int) {
+      auto tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    // O(1)
+    f_iterator& operator--() {
+      begin_assert();
+      --element_;
+      return *this;
+    }
+
+    f_iterator operator--(int) {
+      auto tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    friend bool operator==(const f_iterator& left, const f_iterator& right) {
+      if constexpr (is_tracked) {
+        assert(left.container_ == right.container_);
+        assert(left.container_);
+      }
+      return left.element_ == right.element_;
+    }
+
+    friend bool operator!=(const f_iterator& left, const f_iterator& right) {
+      return !(left == right);
+    }
+
+    friend void swap(f_iterator& left, f_iterator& right) noexcept {
+      f_iterator tmp = left;
+      left = right;
+      right = tmp;
+    }
+  };
+
+public:
+  using key_type = T;
+  using value_type = T;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using allocator_type = Allocator;
+
+  using reference = T&;
+  using const_reference = const T&;
+
+  using pointer = T*;
+  using const_pointer = const T*;
+
+  using iterator = f_iterator;
+  using const_iterator = f_iterator;
+
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+private:
+  std::vector<T, Allocator> elements_;
+  mutable std::conditional_t<is_tracked, iterator_list, no_iterator_list> iterators_;
+
+  using compare_holder<Compare>::comp;
+
+  const T* data_end() const noexcept {
+    return elements_.data() + elements_.size();
+  }
+
+  const_iterator at(std::size_t index) const noexcept {
+    return const_iterator(elements_.data() + index, this);
+  }
+
+  std::size_t index_of(const_iterator it) const noexcept {
+    assert(it.belongs_to(this));
+    it.base_assert();
+    return static_cast<std::size_t>(it.element_ - elements_.data());
+  }
+
+  template <typename K>
+  std::size_t lower_index(const K& key) const {
+    return sorted_lower_index(elements_.data(), elements_.size(), key, comp());
+  }
+
+  template <typename K>
+  std::size_t upper_index(const K& key) const {
+    return sorted_upper_index(elements_.data(), elements_.size(), key, comp());
+  }
+
+  // Index of the element equivalent to key, size() if there is none
+  template <typename K>
+  std::size_t find_index(const K& key) const {
+    std::size_t i = lower_index(key);
+    return i < elements_.size() && !comp()(key, elements_[i]) ? i : elements_.size();
+  }
+
+  // Sorts the elements from index from on, merges them into the sorted prefix and drops duplicates
+  void settle(std::size_t from) {
+    auto equivalent = [this](const T& a, const T& b) { return !comp()(a, b) && !comp()(b, a); };
+    auto middle = elements_.begin() + static_cast<std::ptrdiff_t>(from);
+    std::sort(middle, elements_.end(), comp());
+    std::inplace_merge(elements_.begin(), middle, elements_.end(), comp());
+    elements_.erase(std::unique(elements_.begin(), elements_.end(), equivalent), elements_.end());
+  }
+
+  template <typename V>
+  std::pair<std::size_t, bool> insert_unique(std::size_t i, V&& val) {
+    if (i < elements_.size() && !comp()(val, elements_[i])) {
+      return {i, false};
+    }
+    elements_.insert(elements_.begin() + static_cast<std::ptrdiff_t>(i), std::forward<V>(val));
+    // Only once the insertion has succeeded, a throwing one leaves the iterators valid
+    iterators_.invalidate_iterators();
+    return {i, true};
+  }
+
+  // The insertion index for val if it belongs right before hint, lower_index(val) otherwise
+  std::size_t hinted_index(const_iterator hint, const T& val) const {
+    std::size_t i = index_of(hint);
+    bool before_hint = i == elements_.size() || comp()(val, elements_[i]);
+    bool after_previous = i == 0 || comp()(elements_[i - 1], val);
+    return before_hint && after_previous ? i : lower_index(val);
+  }
+
+public:
+  // O(1) nothrow
+  flat_set() noexcept(std::is_nothrow_default_constructible_v<Compare> &&
+                      std::is_nothrow_default_constructible_v<Allocator>) = default;
+
+  // O(1)
+  explicit flat_set(const Compare& comp, const Allocator& alloc = Allocator())
+      : compare_holder<Compare>(comp), elements_(alloc) {}
+
+  // O(1)
+  explicit flat_set(const Allocator& alloc) : elements_(alloc) {}
+
+  // O(n) strong
+  flat_set(const flat_set& other) : compare_holder<Compare>(other.comp()), elements_(other.elements_) {}
+
+  // O(n) strong
+  flat_set(const flat_set& other, const Allocator& alloc)
+      : compare_holder<Compare>(other.comp()), elements_(other.elements_, alloc) {}
+
+  // O(1) nothrow, O(k) for k live tracked iterators
+  // Iterators keep pointing at their elements, now in this set, and other is left empty
+  flat_set(flat_set&& other) noexcept(std::is_nothrow_copy_constructible_v<Compare>)
+      : compare_holder<Compare>(other.comp()), elements_(other.get_allocator()) {
+    swap(*this, other);
+  }
+
+  // O(n log n) strong, O(n) for sorted input
+  template <typename InputIt, typename = require_input_iterator<InputIt>>
+  flat_set(InputIt first, InputIt last, const Compare& comp = Compare(), const Allocator& alloc = Allocator())
+      : flat_set(comp, alloc) {
+    build_from(first, last);
+  }
+
+  // O(n) strong
+  // The input must be sorted and free of duplicates, which is checked by assert
+  template <typename InputIt, typename = require_input_iterator<InputIt>>
+  flat_set(sorted_unique_t, InputIt first, InputIt last, const Compare& comp = Compare(),
+           const Allocator& alloc = Allocator())
+      : flat_set(comp, alloc) {
+    elements_.assign(first, last);
+    assert(std::adjacent_find(elements_.begin(), elements_.end(),
+                              [this](const T& a, const T& b) { return !this->comp()(a, b); }) == elements_.end());
+  }
+
+  // O(n) strong
+  flat_set& operator=(const flat_set& other) {
+    if (this != &other) {
+      flat_set copy(other);
+      swap(*this, copy);
+    }
+    return *this;
+  }
+
+  // O(n) nothrow, O(k) for k live tracked iterators, when the allocator propagates or the
+  // allocators are equal: the array of other is taken over and its iterators follow it.
+  // Otherwise O(n + m), strong if moving T cannot throw: the elements are moved one by one
+  // into memory of this allocator and the iterators of other are invalidated.
+  // other is left empty either way.
+  flat_set& operator=(flat_set&& other) noexcept(std::is_nothrow_move_assignable_v<std::vector<T, Allocator>>) {
+    if (this == &other) {
+      return *this;
+    }
+    if (std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value ||
+        get_allocator() == other.get_allocator()) {
+      clear();
+      elements_ = std::move(other.elements_);
+      other.elements_.clear();
+      comp() = other.comp();
+      if constexpr (is_tracked) {
+        iterators_.share = std::exchange(other.iterators_.share, nullptr);
+        for (tracked_position* it = iterators_.share; it; it = it->next_) {
+          it->container_ = this;
+        }
+      }
+    } else {
+      std::vector<T, Allocator> moved(std::make_move_iterator(other.elements_.begin()),
+                                      std::make_move_iterator(other.elements_.end()), get_allocator());
+      clear();
+      elements_.swap(moved);
+      comp() = other.comp();
+      other.clear();
+    }
+    return *this;
+  }
+
+  // O(n) nothrow
+  ~flat_set() noexcept {
+    iterators_.invalidate_iterators();
+  }
+
+  // O(n log n) basic, O(n) for sorted input
+  // Replaces the contents with the distinct elements of [first, last): one copy, one sort and
+  // one pass removing duplicates, instead of n insertions
+  template <typename InputIt, typename = require_input_iterator<InputIt>>
+  void build_from(InputIt first, InputIt last) {
+    iterators_.invalidate_iterators();
+    elements_.assign(first, last);
+    if (!std::is_sorted(elements_.begin(), elements_.end(), comp())) {
+      std::sort(elements_.begin(), elements_.end(), comp());
+    }
+    auto equivalent = [this](const T& a, const T& b) { return !comp()(a, b); };
+    elements_.erase(std::unique(elements_.begin(), elements_.end(), equivalent), elements_.end());
+  }
+
+  // O(n log n) basic
+  template <typename Range>
+  void build_from(const Range& range) {
+    build_from(std::begin(range), std::end(range));
+  }
+
+  // O(n) nothrow
+  void clear() noexcept {
+    iterators_.invalidate_iterators();
+    elements_.clear();
+  }
+
+  // O(n) strong, invalidates all iterators if the array is reallocated
+  void reserve(std::size_t capacity) {
+    if (capacity > elements_.capacity()) {
+      elements_.reserve(capacity);
+      iterators_.invalidate_iterators();
+    }
+  }
+
+  // O(1) nothrow
+  std::size_t capacity() const noexcept {
+    return elements_.capacity();
+  }
+
+  // O(1) nothrow
+  // The elements in order, size() of them
+  const T* data() const noexcept {
+    return elements_.data();
+  }
+
+  // O(1) nothrow
+  allocator_type get_allocator() const noexcept {
+    return elements_.get_allocator();
+  }
+
+  // O(1) nothrow
+  size_t size() const noexcept {
+    return elements_.size();
+  }
+
+  // O(1) nothrow
+  bool empty() const noexcept {
+    return elements_.empty();
+  }
+
+  // nothrow
+  const_iterator begin() const noexcept {
+    return at(0);
+  }
+
+  // nothrow
+  const_iterator end() const noexcept {
+    return at(elements_.size());
+  }
+
+  // nothrow
+  const_reverse_iterator rbegin() const noexcept {
+    return reverse_iterator(end());
+  }
+
+  // nothrow
+  const_reverse_iterator rend() const noexcept {
+    return reverse_iterator(begin());
+  }
+
+  // O(n) strong, invalidates all iterators if val is inserted
+  std::pair<iterator, bool> insert(const T& val) {
+    auto [i, inserted] = insert_unique(lower_index(val), val);
+    return {at(i), inserted};
+  }
+
+  // O(n) strong, invalidates all iterators if val is inserted
+  std::pair<iterator, bool> insert(T&& val) {
+    auto [i, inserted] = insert_unique(lower_index(val), std::move(val));
+    return {at(i), inserted};
+  }
+
+  // O(1) comparisons if val belongs right before hint, O(log n) otherwise, plus O(n) moves, strong
+  iterator insert(const_iterator hint, const T& val) {
+    return at(insert_unique(hinted_index(hint, val), val).first);
+  }
+
+  // O(1) comparisons if val belongs right before hint, O(log n) otherwise, plus O(n) moves, strong
+  iterator insert(const_iterator hint, T&& val) {
+    return at(insert_unique(hinted_index(hint, val), std::move(val)).first);
+  }
+
+  // O(n + k log k) basic
+  // Appends the new elements, sorts them and merges them in, instead of k shifting insertions
+  template <typename InputIt, typename = require_input_iterator<InputIt>>
+  void insert(InputIt first, InputIt last) {
+    iterators_.invalidate_iterators();
+    std::size_t old_size = elements_.size();
+    elements_.insert(elements_.end(), first, last);
+    settle(old_size);
+  }
+
+  // O(n) strong
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    return insert(T(std::forward<Args>(args)...));
+  }
+
+  // O(n) strong
+  template <typename... Args>
+  iterator emplace_hint(const_iterator hint, Args&&... args) {
+    return insert(hint, T(std::forward<Args>(args)...));
+  }
+
+  // O(n) nothrow if T moves without throwing, invalidates all iterators.
+  // Returns the iterator to the element that followed the erased one.
+  iterator erase(const_iterator pos) {
+    pos.end_assert();
+    std::size_t i = index_of(pos);
+    iterators_.invalidate_iterators();
+    elements_.erase(elements_.begin() + static_cast<std::ptrdiff_t>(i));
+    return at(i);
+  }
+
+  // O(n) nothrow if T moves without throwing, invalidates all iterators
+  iterator erase(const_iterator first, const_iterator last) {
+    std::size_t from = index_of(first);
+    std::size_t to = index_of(last);
+    assert(from <= to);
+    if (from != to) {
+      iterators_.invalidate_iterators();
+      elements_.erase(elements_.begin() + static_cast<std::ptrdiff_t>(from),
+                      elements_.begin() + static_cast<std::ptrdiff_t>(to));
+    }
+    return at(from);
+  }
+
+  // O(n) strong
+  size_t erase(const T& val) {
+    std::size_t i = find_index(val);
+    if (i == elements_.size()) {
+      return 0;
+    }
+    elements_.erase(elements_.begin() + static_cast<std::ptrdiff_t>(i));
+    iterators_.invalidate_iterators();
+    return 1;
+  }
+
+  // O(n) basic
+  // Erases the elements satisfying pred in one pass, invalidates all iterators
+  template <typename Pred>
+  friend std::size_t erase_if(flat_set& s, Pred pred) {
+    s.iterators_.invalidate_iterators();
+    auto kept_end = std::remove_if(s.elements_.begin(), s.elements_.end(), pred);
+    std::size_t erased = static_cast<std::size_t>(s.elements_.end() - kept_end);
+    s.elements_.erase(kept_end, s.elements_.end());
+    return erased;
+  }
+
+  // O(log n) strong
+  const_iterator find(const T& val) const {
+    return at(find_index(val));
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator find(const K& key) const {
+    return at(find_index(key));
+  }
+
+  // O(log n) strong
+  size_t count(const T& val) const {
+    return contains(val) ? 1 : 0;
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  size_t count(const K& key) const {
+    return contains(key) ? 1 : 0;
+  }
+
+  // O(log n) strong
+  bool contains(const T& val) const {
+    return find_index(val) != elements_.size();
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  bool contains(const K& key) const {
+    return find_index(key) != elements_.size();
+  }
+
+  // O(log n) strong
+  const_iterator lower_bound(const T& val) const {
+    return at(lower_index(val));
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator lower_bound(const K& key) const {
+    return at(lower_index(key));
+  }
+
+  // O(log n) strong
+  const_iterator upper_bound(const T& val) const {
+    return at(upper_index(val));
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator upper_bound(const K& key) const {
+    return at(upper_index(key));
+  }
+
+  // O(m log n) strong for m keys
+  // found[i] tells whether keys[i] is in the set, no iterators are made
+  void contains_many(const T* keys, std::size_t count, bool* found) const {
+    for (std::size_t i = 0; i < count; ++i) {
+      found[i] = find_index(keys[i]) != elements_.size();
+    }
+  }
+
+  // O(m log n) strong for m keys
+  // result[i] points at the least element not less than keys[i], nullptr if there is none
+  void lower_bound_many(const T* keys, std::size_t count, const T** result) const {
+    for (std::size_t i = 0; i < count; ++i) {
+      std::size_t j = lower_index(keys[i]);
+      result[i] = j < elements_.size() ? &elements_[j] : nullptr;
+    }
+  }
+
+  // O(1)
+  key_compare key_comp() const {
+    return comp();
+  }
+
+  // O(1)
+  value_compare value_comp() const {
+    return comp();
+  }
+
+  // O(k) nothrow for k live tracked iterators, O(1) otherwise.
+  // The arrays are swapped, not copied, so iterators, end() ones included, keep pointing
+  // into the same array, now owned by the other set.
+  friend void swap(flat_set& lhs, flat_set& rhs) noexcept {
+    using std::swap;
+    swap(lhs.elements_, rhs.elements_);
+    swap(lhs.comp(), rhs.comp());
+    if constexpr (is_tracked) {
+      swap(lhs.iterators_.share, rhs.iterators_.share);
+      for (flat_set* s : {&lhs, &rhs}) {
+        for (tracked_position* it = s->iterators_.share; it; it = it->next_) {
+          it->container_ = s;
+        }
+      }
+    }
+  }
+};
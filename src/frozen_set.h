@@ -0,0 +1,448 @@
+#pragma once
+
+#include "set.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Immutable snapshot of a sorted set, for data that is built once and then only searched.
+// The elements are kept in one allocation in Eytzinger order: slot k holds the root of an
+// implicit tree whose children are slots 2k and 2k + 1. A lookup walks one root-to-leaf path
+// with a select instead of a branch, and the top levels of the path share a few cache lines,
+// so it misses the cache much less often than a walk over linked nodes.
+//
+// Nothing is ever changed after construction, so iterators stay valid for the lifetime of
+// the snapshot, and the lookups write no memory at all: any number of threads may search the
+// same snapshot at once.
+template <typename T, typename Compare = std::less<T>>
+class frozen_set : private compare_holder<Compare> {
+  // Slots are numbered from 1, slot k lives at elements_[k - 1] and 0 means no slot
+  T* elements_{nullptr};
+  std::size_t size_{0};
+
+  using compare_holder<Compare>::comp;
+
+  class z_iterator;
+
+  // The slot holding the least element
+  std::size_t first_slot() const noexcept {
+    std::size_t k = size_ ? 1 : 0;
+    while (k && 2 * k <= size_) {
+      k *= 2;
+    }
+    return k;
+  }
+
+  // The slot holding the greatest element
+  std::size_t last_slot() const noexcept {
+    std::size_t k = size_ ? 1 : 0;
+    while (k && 2 * k + 1 <= size_) {
+      k = 2 * k + 1;
+    }
+    return k;
+  }
+
+  // In-order successor in the implicit tree, 0 after the last slot
+  std::size_t next_slot(std::size_t k) const noexcept {
+    if (2 * k + 1 <= size_) {
+      k = 2 * k + 1;
+      while (2 * k <= size_) {
+        k *= 2;
+      }
+      return k;
+    }
+    while (k & 1) {
+      k >>= 1;
+    }
+    return k >> 1;
+  }
+
+  // In-order predecessor in the implicit tree, 0 before the first slot
+  std::size_t prev_slot(std::size_t k) const noexcept {
+    if (2 * k <= size_) {
+      k = 2 * k;
+      while (2 * k + 1 <= size_) {
+        k = 2 * k + 1;
+      }
+      return k;
+    }
+    while (k && !(k & 1)) {
+      k >>= 1;
+    }
+    return k >> 1;
+  }
+
+  const T& slot(std::size_t k) const noexcept {
+    return elements_[k - 1];
+  }
+
+  // A path that ends after a last right turn at slot k has its answer at the slot where the
+  // path last went left, which is k with the trailing right turns (low 1 bits) and one more bit cut
+  static std::size_t last_left_turn(std::size_t k) noexcept {
+    while (k & 1) {
+      k >>= 1;
+    }
+    return k >> 1;
+  }
+
+  // Prefetching this many levels ahead brings in a whole cache line of descendants
+  static constexpr std::size_t prefetch_stride = std::max<std::size_t>(1, 64 / sizeof(T));
+
+  // Near the leaves the target is clamped to the last slot rather than tested, to keep the loop free of branches
+  void prefetch_below(std::size_t k) const noexcept {
+    prefetch_address(elements_ + std::min(k * prefetch_stride, size_) - 1);
+  }
+
+  // The slot of the least element not less than key, 0 if there is none
+  template <typename K>
+  std::size_t lower_slot(const K& key) const {
+    std::size_t k = 1;
+    while (k <= size_) {
+      prefetch_below(k);
+      k = 2 * k + comp()(slot(k), key);
+    }
+    return last_left_turn(k);
+  }
+
+  // The slot of the least element greater than key, 0 if there is none
+  template <typename K>
+  std::size_t upper_slot(const K& key) const {
+    std::size_t k = 1;
+    while (k <= size_) {
+      prefetch_below(k);
+      k = 2 * k + !comp()(key, slot(k));
+    }
+    return last_left_turn(k);
+  }
+
+  template <typename K>
+  std::size_t find_slot(const K& key) const {
+    std::size_t k = lower_slot(key);
+    return k && !comp()(key, slot(k)) ? k : 0;
+  }
+
+  // Lookups of a batch walking the array side by side
+  static constexpr std::size_t probe_group = 8;
+
+  // Finds the lower bounds of keys in groups of probe_group, every step of a lookup prefetches
+  // its next slots and moves on to the other lookups. finish(i, k) gets the slot of the lower
+  // bound of keys[i], 0 if there is none.
+  template <typename Finish>
+  void lower_slots_grouped(const T* keys, std::size_t count, Finish finish) const {
+    for (std::size_t base = 0; base < count; base += probe_group) {
+      std::size_t lanes = std::min(probe_group, count - base);
+      std::size_t current[probe_group];
+      for (std::size_t l = 0; l < lanes; ++l) {
+        current[l] = 1;
+      }
+      for (bool active = size_ != 0; active;) {
+        active = false;
+        for (std::size_t l = 0; l < lanes; ++l) {
+          std::size_t k = current[l];
+          if (k > size_) {
+            continue;
+          }
+          prefetch_below(k);
+          k = 2 * k + comp()(slot(k), keys[base + l]);
+          current[l] = k;
+          active |= k <= size_;
+        }
+      }
+      for (std::size_t l = 0; l < lanes; ++l) {
+        finish(base + l, last_left_turn(current[l]));
+      }
+    }
+  }
+
+  static T* allocate(std::size_t n) {
+    return n ? std::allocator<T>().allocate(n) : nullptr;
+  }
+
+  // Destroys the first built slots in the order they were constructed by fill
+  void destroy_built(std::size_t built) noexcept {
+    for (std::size_t k = first_slot(); built; k = next_slot(k), --built) {
+      elements_[k - 1].~T();
+    }
+  }
+
+  // Copy constructs the slots in order from first, so a sorted range becomes the
+  // Eytzinger layout in one pass
+  template <typename InputIt>
+  void fill(InputIt first) {
+    std::size_t built = 0;
+    try {
+      for (std::size_t k = first_slot(); k; k = next_slot(k), ++first, ++built) {
+        ::new (static_cast<void*>(elements_ + k - 1)) T(*first);
+      }
+    } catch (...) {
+      destroy_built(built);
+      std::allocator<T>().deallocate(elements_, size_);
+      throw;
+    }
+  }
+
+  class z_iterator {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = T;
+    using reference = const T&;
+    using pointer = const T*;
+
+  private:
+    const frozen_set* container_{nullptr};
+    std::size_t slot_{0};
+
+    z_iterator(const frozen_set* container, std::size_t slot) noexcept : container_(container), slot_(slot) {}
+
+    friend frozen_set;
+
+  public:
+    z_iterator() noexcept = default;
+
+    reference operator*() const {
+      assert(container_ && slot_);
+      return container_->slot(slot_);
+    }
+
+    pointer operator->() const {
+      return &**this;
+    }
+
+    // O(log n), O(1) amortized over a full walk
+    z_iterator& operator++() {
+      assert(container_ && slot_);
+      slot_ = container_->next_slot(slot_);
+      return *this;
+    }
+
+    z_iterator operator++(int) {
+      auto tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    // O(log n), O(1) amortized over a full walk
+    z_iterator& operator--() {
+      assert(container_);
+      slot_ = slot_ ? container_->prev_slot(slot_) : container_->last_slot();
+      assert(slot_);
+      return *this;
+    }
+
+    z_iterator operator--(int) {
+      auto tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    friend bool operator==(const z_iterator& left, const z_iterator& right) {
+      assert(left.container_ == right.container_);
+      return left.slot_ == right.slot_;
+    }
+
+    friend bool operator!=(const z_iterator& left, const z_iterator& right) {
+      return !(left == right);
+    }
+  };
+
+public:
+  using key_type = T;
+  using value_type = T;
+  using key_compare = Compare;
+  using value_compare = Compare;
+
+  using reference = const T&;
+  using const_reference = const T&;
+
+  using iterator = z_iterator;
+  using const_iterator = z_iterator;
+
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  // O(1) nothrow
+  frozen_set() noexcept(std::is_nothrow_default_constructible_v<Compare>) = default;
+
+  // O(n) strong
+  // Takes count elements of the sorted, duplicate free range starting at first, checked by assert
+  template <typename InputIt, typename = require_input_iterator<InputIt>>
+  frozen_set(sorted_unique_t, InputIt first, std::size_t count, const Compare& comp = Compare())
+      : compare_holder<Compare>(comp), elements_(allocate(count)), size_(count) {
+    fill(first);
+    assert(std::adjacent_find(begin(), end(), [this](const T& a, const T& b) {
+             return !this->comp()(a, b);
+           }) == end());
+  }
+
+  // O(n) strong
+  frozen_set(const frozen_set& other)
+      : compare_holder<Compare>(other.comp()), elements_(allocate(other.size_)), size_(other.size_) {
+    fill(other.begin());
+  }
+
+  // O(1) nothrow, other is left empty and iterators into it are not carried over
+  frozen_set(frozen_set&& other) noexcept(std::is_nothrow_copy_constructible_v<Compare>)
+      : compare_holder<Compare>(other.comp()), elements_(std::exchange(other.elements_, nullptr)),
+        size_(std::exchange(other.size_, 0)) {}
+
+  // O(n) strong
+  frozen_set& operator=(const frozen_set& other) {
+    if (this != &other) {
+      frozen_set copy(other);
+      swap(*this, copy);
+    }
+    return *this;
+  }
+
+  // O(n) nothrow
+  frozen_set& operator=(frozen_set&& other) noexcept {
+    if (this != &other) {
+      frozen_set tmp(std::move(other));
+      swap(*this, tmp);
+    }
+    return *this;
+  }
+
+  // O(n) nothrow
+  ~frozen_set() noexcept {
+    destroy_built(size_);
+    if (elements_) {
+      std::allocator<T>().deallocate(elements_, size_);
+    }
+  }
+
+  // O(1) nothrow
+  size_t size() const noexcept {
+    return size_;
+  }
+
+  // O(1) nothrow
+  bool empty() const noexcept {
+    return size_ == 0;
+  }
+
+  // O(log n) nothrow
+  const_iterator begin() const noexcept {
+    return const_iterator(this, first_slot());
+  }
+
+  // nothrow
+  const_iterator end() const noexcept {
+    return const_iterator(this, 0);
+  }
+
+  // O(log n) nothrow
+  const_reverse_iterator rbegin() const noexcept {
+    return reverse_iterator(end());
+  }
+
+  // O(log n) nothrow
+  const_reverse_iterator rend() const noexcept {
+    return reverse_iterator(begin());
+  }
+
+  // O(log n) strong
+  const_iterator find(const T& val) const {
+    return const_iterator(this, find_slot(val));
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator find(const K& key) const {
+    return const_iterator(this, find_slot(key));
+  }
+
+  // O(log n) strong
+  size_t count(const T& val) const {
+    return find_slot(val) ? 1 : 0;
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  size_t count(const K& key) const {
+    return find_slot(key) ? 1 : 0;
+  }
+
+  // O(log n) strong
+  bool contains(const T& val) const {
+    return find_slot(val) != 0;
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  bool contains(const K& key) const {
+    return find_slot(key) != 0;
+  }
+
+  // O(log n) strong
+  const_iterator lower_bound(const T& val) const {
+    return const_iterator(this, lower_slot(val));
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator lower_bound(const K& key) const {
+    return const_iterator(this, lower_slot(key));
+  }
+
+  // O(log n) strong
+  const_iterator upper_bound(const T& val) const {
+    return const_iterator(this, upper_slot(val));
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator upper_bound(const K& key) const {
+    return const_iterator(this, upper_slot(key));
+  }
+
+  // O(m log n) strong for m keys
+  // found[i] tells whether keys[i] is in the set. Up to 8 lookups descend at once,
+  // so the cache misses of one are hidden behind the others.
+  void contains_many(const T* keys, std::size_t count, bool* found) const {
+    lower_slots_grouped(keys, count,
+                        [&](std::size_t i, std::size_t k) { found[i] = k && !comp()(keys[i], slot(k)); });
+  }
+
+  // O(m log n) strong for m keys
+  // result[i] points at the least element not less than keys[i], nullptr if there is none
+  void lower_bound_many(const T* keys, std::size_t count, const T** result) const {
+    lower_slots_grouped(keys, count, [&](std::size_t i, std::size_t k) { result[i] = k ? &slot(k) : nullptr; });
+  }
+
+  // O(1)
+  key_compare key_comp() const {
+    return comp();
+  }
+
+  // O(1)
+  value_compare value_comp() const {
+    return comp();
+  }
+
+  // O(1) nothrow
+  // Iterators belong to the snapshot object, after a swap they walk its new contents
+  friend void swap(frozen_set& lhs, frozen_set& rhs) noexcept {
+    using std::swap;
+    swap(lhs.elements_, rhs.elements_);
+    swap(lhs.size_, rhs.size_);
+    swap(lhs.comp(), rhs.comp());
+  }
+};
+
+// O(n) strong
+// A frozen snapshot of any of the sorted sets (set, btree_set, flat_set), built from one in-order
+// walk without comparisons. The source is not changed and its iterators are unaffected.
+template <typename Set>
+frozen_set<typename Set::value_type, typename Set::key_compare> freeze(const Set& s) {
+  using frozen = frozen_set<typename Set::value_type, typename Set::key_compare>;
+  return frozen(sorted_unique, s.begin(), s.size(), s.key_comp());
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "flat_set.h"
+#include "set.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+// Read-only set over a file written by set::serialize, searched in place. Opening maps the file
+// and checks its header, the elements are neither read nor copied, so startup costs O(1) whatever
+// the size and the pages are loaded by the lookups that touch them. Several processes mapping
+// the same file share its pages.
+//
+// The elements are a sorted array, so the lookups are those of flat_set. The contents never
+// change, iterators are plain pointers into the mapping and stay valid while the mapped_set
+// lives. POSIX only.
+template <typename T, typename Compare = std::less<T>>
+class mapped_set : private compare_holder<Compare> {
+  static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable elements are serialized in binary form");
+
+  void* mapping_{nullptr};
+  std::size_t mapping_size_{0};
+  const T* elements_{nullptr};
+  std::size_t size_{0};
+
+  using compare_holder<Compare>::comp;
+
+  template <typename K>
+  std::size_t find_index(const K& key) const {
+    std::size_t i = sorted_lower_index(elements_, size_, key, comp());
+    return i < size_ && !comp()(key, elements_[i]) ? i : size_;
+  }
+
+  void unmap() noexcept {
+    if (mapping_) {
+      munmap(mapping_, mapping_size_);
+    }
+  }
+
+public:
+  using key_type = T;
+  using value_type = T;
+  using key_compare = Compare;
+  using value_compare = Compare;
+
+  using reference = const T&;
+  using const_reference = const T&;
+
+  using iterator = const T*;
+  using const_iterator = const T*;
+
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  // O(1) nothrow
+  mapped_set() noexcept(std::is_nothrow_default_constructible_v<Compare>) = default;
+
+  // O(1), O(n) in debug builds, which check the order by assert
+  // Maps the file at path. Throws std::system_error if it cannot be opened or mapped and
+  // std::runtime_error if it does not hold a set of T.
+  explicit mapped_set(const std::string& path, const Compare& comp = Compare()) : compare_holder<Compare>(comp) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+      int error = errno;
+      ::close(fd);
+      throw std::system_error(error, std::generic_category(), "cannot stat " + path);
+    }
+    std::size_t file_size = static_cast<std::size_t>(info.st_size);
+    if (file_size < sizeof(set_file_header)) {
+      ::close(fd);
+      throw std::runtime_error(path + " is not a serialized set");
+    }
+    void* mapping = ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    int error = errno;
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+      throw std::system_error(error, std::generic_category(), "cannot map " + path);
+    }
+    mapping_ = mapping;
+    mapping_size_ = file_size;
+    const auto* header = static_cast<const set_file_header*>(mapping);
+    if (!header->describes<T>() || header->count > (file_size - sizeof(set_file_header)) / sizeof(T)) {
+      unmap();
+      throw std::runtime_error(path + " does not hold a serialized set of this type");
+    }
+    elements_ = reinterpret_cast<const T*>(header + 1);
+    size_ = static_cast<std::size_t>(header->count);
+    assert(std::adjacent_find(elements_, elements_ + size_, [this](const T& a, const T& b) {
+             return !this->comp()(a, b);
+           }) == elements_ + size_);
+  }
+
+  mapped_set(const mapped_set&) = delete;
+  mapped_set& operator=(const mapped_set&) = delete;
+
+  // O(1) nothrow, other is left empty
+  mapped_set(mapped_set&& other) noexcept(std::is_nothrow_copy_constructible_v<Compare>)
+      : compare_holder<Compare>(other.comp()), mapping_(std::exchange(other.mapping_, nullptr)),
+        mapping_size_(std::exchange(other.mapping_size_, 0)), elements_(std::exchange(other.elements_, nullptr)),
+        size_(std::exchange(other.size_, 0)) {}
+
+  // O(1) nothrow
+  mapped_set& operator=(mapped_set&& other) noexcept {
+    if (this != &other) {
+      mapped_set tmp(std::move(other));
+      swap(*this, tmp);
+    }
+    return *this;
+  }
+
+  // O(1) nothrow
+  ~mapped_set() noexcept {
+    unmap();
+  }
+
+  // O(1) nothrow
+  size_t size() const noexcept {
+    return size_;
+  }
+
+  // O(1) nothrow
+  bool empty() const noexcept {
+    return size_ == 0;
+  }
+
+  // O(1) nothrow
+  const T* data() const noexcept {
+    return elements_;
+  }
+
+  // nothrow
+  const_iterator begin() const noexcept {
+    return elements_;
+  }
+
+  // nothrow
+  const_iterator end() const noexcept {
+    return elements_ + size_;
+  }
+
+  // nothrow
+  const_reverse_iterator rbegin() const noexcept {
+    return reverse_iterator(end());
+  }
+
+  // nothrow
+  const_reverse_iterator rend() const noexcept {
+    return reverse_iterator(begin());
+  }
+
+  // O(log n) strong
+  const_iterator find(const T& val) const {
+    return elements_ + find_index(val);
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator find(const K& key) const {
+    return elements_ + find_index(key);
+  }
+
+  // O(log n) strong
+  size_t count(const T& val) const {
+    return contains(val) ? 1 : 0;
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  size_t count(const K& key) const {
+    return contains(key) ? 1 : 0;
+  }
+
+  // O(log n) strong
+  bool contains(const T& val) const {
+    return find_index(val) != size_;
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  bool contains(const K& key) const {
+    return find_index(key) != size_;
+  }
+
+  // O(log n) strong
+  const_iterator lower_bound(const T& val) const {
+    return elements_ + sorted_lower_index(elements_, size_, val, comp());
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator lower_bound(const K& key) const {
+    return elements_ + sorted_lower_index(elements_, size_, key, comp());
+  }
+
+  // O(log n) strong
+  const_iterator upper_bound(const T& val) const {
+    return elements_ + sorted_upper_index(elements_, size_, val, comp());
+  }
+
+  // O(log n) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator upper_bound(const K& key) const {
+    return elements_ + sorted_upper_index(elements_, size_, key, comp());
+  }
+
+  // O(m log n) strong for m keys
+  // found[i] tells whether keys[i] is in the set
+  void contains_many(const T* keys, std::size_t count, bool* found) const {
+    for (std::size_t i = 0; i < count; ++i) {
+      found[i] = find_index(keys[i]) != size_;
+    }
+  }
+
+  // O(m log n) strong for m keys
+  // result[i] points at the least element not less than keys[i], nullptr if there is none
+  void lower_bound_many(const T* keys, std::size_t count, const T** result) const {
+    for (std::size_t i = 0; i < count; ++i) {
+      std::size_t j = sorted_lower_index(elements_, size_, keys[i], comp());
+      result[i] = j < size_ ? elements_ + j : nullptr;
+    }
+  }
+
+  // O(1)
+  key_compare key_comp() const {
+    return comp();
+  }
+
+  // O(1)
+  value_compare value_comp() const {
+    return comp();
+  }
+
+  // O(1) nothrow
+  friend void swap(mapped_set& lhs, mapped_set& rhs) noexcept {
+    using std::swap;
+    swap(lhs.mapping_, rhs.mapping_);
+    swap(lhs.mapping_size_, rhs.mapping_size_);
+    swap(lhs.elements_, rhs.elements_);
+    swap(lhs.size_, rhs.size_);
+    swap(lhs.comp(), rhs.comp());
+  }
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "set.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// The parallel operations of set, kept apart so that set.h does not pull in threads.
+// The executor is any callable taking a std::function<void()>, see thread_pool.h. parts is the
+// number of pieces the work is cut into, one per hardware thread by default; pieces smaller
+// than 2^14 elements are not made, and small sets are handled in the calling thread.
+
+// The bodies of the operations below, a friend of set
+struct set_parallel {
+  template <typename Set, typename Executor>
+  static Set copy(const Set& s, Executor& executor, std::size_t parts) {
+    static_assert(!Set::is_counted, "the copying tasks would count into the same set at once");
+    static_assert(!Set::is_generation_checked, "the copying tasks would stamp the nodes of the same set at once");
+    static_assert(Set::inline_capacity == 0, "the copying tasks would take the inline slots of the same set at once");
+    parts = Set::parallel_parts(parts, s.size_);
+    if (parts < 2) {
+      return Set(s);
+    }
+    Set copy(0, s.comp(), Set::node_traits::select_on_container_copy_construction(s.alloc_));
+    // The nodes down to depth are copied here, which leaves at least parts subtrees below them
+    std::size_t depth = 0;
+    while ((std::size_t(2) << depth) < parts) {
+      ++depth;
+    }
+    std::vector<typename Set::copy_job> jobs;
+    jobs.reserve(std::size_t(2) << depth);
+    typename Set::sentinel_node* root = copy.copy_top(s.take_root(), nullptr, depth, jobs);
+    try {
+      run_parallel(executor, jobs.size(), [&](std::size_t i) {
+        *jobs[i].slot = copy.copy_tree(jobs[i].from);
+        (*jobs[i].slot)->set_parent(jobs[i].parent);
+      });
+    } catch (...) {
+      copy.del_subtree(root);
+      throw;
+    }
+    copy.install_tree(root);
+    copy.size_ = s.size_;
+    copy.link_all_in_order();
+    return copy;
+  }
+
+  template <typename Set, typename Executor>
+  static void destroy_later(Set& s, Executor& executor) {
+    s.modify_assert();
+    if (s.empty()) {
+      return;
+    }
+    s.invalidate_element_iterators();
+    std::shared_ptr<Set> doomed(new Set(0, s.comp(), s.alloc_));
+    swap(s, *doomed);
+    executor(std::function<void()>([doomed]() mutable { doomed.reset(); }));
+  }
+
+  template <typename Set, typename Executor>
+  static void merge(Set& target, Set& source, Executor& executor, std::size_t parts) {
+    if (&target == &source || source.empty()) {
+      return;
+    }
+    parts = Set::parallel_parts(parts, target.size_ + source.size_);
+    if (parts < 2 || !target.can_take_nodes_from(source)) {
+      target.merge(source);
+      return;
+    }
+    auto keys = (target.size_ >= source.size_ ? target : source).cut_keys(parts);
+    std::vector<Set> mine;
+    std::vector<Set> theirs;
+    target.split_pieces(keys, mine);
+    source.split_pieces(keys, theirs);
+    try {
+      run_parallel(executor, keys.size() + 1, [&](std::size_t i) {
+        (i == 0 ? target : mine[i - 1]).merge(i == 0 ? source : theirs[i - 1]);
+      });
+    } catch (...) {
+      target.join_pieces(mine);
+      source.join_pieces(theirs);
+      throw;
+    }
+    target.join_pieces(mine);
+    source.join_pieces(theirs);
+  }
+
+  template <typename Set, typename Executor>
+  static void intersect(Set& target, const Set& other, Executor& executor, std::size_t parts) {
+    if (&target == &other || target.empty()) {
+      return;
+    }
+    if (other.empty()) {
+      target.clear();
+      return;
+    }
+    parts = Set::parallel_parts(parts, target.size_ + other.size_);
+    if (parts < 2) {
+      target.intersect(other);
+      return;
+    }
+    auto keys = target.cut_keys(parts);
+    std::vector<typename Set::sentinel_node*> starts;
+    starts.reserve(keys.size() + 1);
+    for (const auto& key : keys) {
+      starts.push_back(other.last_below(key));
+    }
+    starts.push_back(other.rightmost_);
+    std::vector<Set> mine;
+    target.split_pieces(keys, mine);
+    try {
+      run_parallel(executor, keys.size() + 1, [&](std::size_t i) {
+        Set& piece = i == 0 ? target : mine[i - 1];
+        if (!piece.empty()) {
+          piece.filter_linear(starts[i], true);
+        }
+      });
+    } catch (...) {
+      target.join_pieces(mine);
+      throw;
+    }
+    target.join_pieces(mine);
+  }
+};
+
+// O(n / p) time on p threads, O(n) work, strong.
+// A copy of s whose subtrees below the top levels are copied by parts tasks through executor.
+// The allocator must be usable from several threads at once, arena_allocator is not.
+template <typename T, typename Compare, typename Allocator, typename Policy, typename Executor>
+set<T, Compare, Allocator, Policy> parallel_copy(const set<T, Compare, Allocator, Policy>& s, Executor&& executor,
+                                                 std::size_t parts = std::thread::hardware_concurrency()) {
+  return set_parallel::copy(s, executor, parts);
+}
+
+// O(n) in the calling thread with checked iterators, O(1) otherwise.
+// Moves the contents of s out and destroys them in a task of executor, so freeing a large set
+// does not hold up the caller, and leaves s empty. Iterators into it are invalidated here,
+// before the nodes leave this thread. If executor throws, the contents are destroyed here
+// instead. The allocator must be usable from the thread the task runs on.
+template <typename T, typename Compare, typename Allocator, typename Policy, typename Executor>
+void destroy_later(set<T, Compare, Allocator, Policy>& s, Executor&& executor) {
+  set_parallel::destroy_later(s, executor);
+}
+
+// O((n + m) / p) time on p threads plus O(h p) to cut the sets, basic guarantee.
+// The same as target.merge(source). Both sets are cut into parts pieces at the same keys by
+// split, the pieces are merged pairwise by tasks of executor and joined back. Without
+// subtree_sizes or with tracked iterators, cutting the sets walks the moved elements, O(n + m).
+template <typename T, typename Compare, typename Allocator, typename Policy, typename Executor>
+void parallel_merge(set<T, Compare, Allocator, Policy>& target, set<T, Compare, Allocator, Policy>& source,
+                    Executor&& executor, std::size_t parts = std::thread::hardware_concurrency()) {
+  set_parallel::merge(target, source, executor, parts);
+}
+
+// O((n + m) / p) time on p threads plus O(h p) to cut target, basic guarantee.
+// The same as target.intersect(other). target is cut into parts pieces by split, each piece is
+// filtered by a task of executor against its own range of other, and the pieces are joined back.
+// other is only read. The pieces free their nodes at once, so the allocator must be usable
+// from several threads.
+template <typename T, typename Compare, typename Allocator, typename Policy, typename Executor>
+void parallel_intersect(set<T, Compare, Allocator, Policy>& target, const set<T, Compare, Allocator, Policy>& other,
+                        Executor&& executor, std::size_t parts = std::thread::hardware_concurrency()) {
+  set_parallel::intersect(target, other, executor, parts);
+}
@@ -1,88 +1,684 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <iostream>
+#include <cstdint>
+#include <functional>
+#include <istream>
 #include <iterator>
+#include <memory>
+#include <new>
+#include <optional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+// Iterator lists of the tracked modes link iterators that may be locals of a caller. When that
+// caller got the container by reference, GCC takes the link for a dangling store, though
+// the iterator unlinks itself in its destructor.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#define DEBUG_SET_LOCAL_ITERATORS_BEGIN \
+  _Pragma("GCC diagnostic push") _Pragma("GCC diagnostic ignored \"-Wdangling-pointer\"")
+#define DEBUG_SET_LOCAL_ITERATORS_END _Pragma("GCC diagnostic pop")
+#else
+#define DEBUG_SET_LOCAL_ITERATORS_BEGIN
+#define DEBUG_SET_LOCAL_ITERATORS_END
+#endif
+
+// Balancing policies. Each one only declares the bookkeeping it keeps in every node,
+// the algorithms themselves live in set.
+struct no_balance {
+  struct node_data {};
+};
+
+// The color is kept in the lowest bit of the parent pointer
+struct red_black_balance {
+  struct node_data {};
+};
+
+struct avl_balance {
+  struct node_data {
+    unsigned char height{1};
+  };
+};
+
+// Order statistics policies. With subtree_sizes every node counts the elements of its subtree,
+// which makes positional queries O(h) at the cost of one word per node.
+struct no_order_statistics {
+  struct node_data {};
+};
+
+struct subtree_sizes {
+  struct node_data {
+    std::size_t subtree_size{1};
+  };
+};
+
+// Iterator checking policies.
+// Every node keeps the list of iterators pointing at it, so misuse of an iterator aborts
+struct tracked_iterators {};
+
+// Iterators are bare node pointers and nodes carry no list, misuse is undefined behaviour
+struct unchecked_iterators {};
+
+// Every node carries a generation stamp that changes when the node is destroyed or extracted,
+// an iterator keeps the stamp it saw and compares it in O(1) on every use. Nothing is registered,
+// but a stamp can only be read while the memory of the node is not returned to the system.
+struct generation_checked_iterators {};
+
+// Sets with generation_checked_iterators stamp their nodes from disjoint ranges taken here.
+// A stamp is a range number in the upper half of a word and a count in the lower one, so there
+// are 2^32 ranges of 2^31 stamps on 64-bit targets but only 2^16 ranges of 2^15 stamps on 32-bit
+// ones. A set takes its first range with its first node and a new one when its range is used
+// up; running out of ranges aborts by assert.
+inline std::atomic<std::uintptr_t> generation_ranges{0};
+
+// The odd stamps of end(), one per set, so that end() of a set that is gone stays dead
+inline std::atomic<std::uintptr_t> generation_ends{0};
+
+// Traversal policies. With parent pointers only, ++ and -- climb the tree and cost O(h) in the worst case.
+// With linked_traversal every node also links its in-order neighbours, which makes them O(1)
+// at the cost of two words per node.
+struct parent_traversal {};
+
+struct linked_traversal {};
+
+// Operation counting. With operation_counters every set keeps the set_counters below,
+// without it the counting compiles to nothing.
+struct no_counters {};
+
+struct operation_counters {};
+
+// Counters of one set since its construction or reset_stats(), see set::stats()
+struct set_counters {
+  // Calls of the comparator
+  std::uint64_t comparisons{0};
+  // Descents from the root and the nodes they visited, the ratio is the average search depth
+  std::uint64_t searches{0};
+  std::uint64_t search_steps{0};
+  // Steps of iterators that know their set, which only tracked ones do
+  std::uint64_t iterator_steps{0};
+  // Nodes taken from and returned to the allocator, inline nodes are not counted
+  std::uint64_t node_allocations{0};
+  std::uint64_t node_frees{0};
+  // Iterators added to the list of a node, with tracked_iterators
+  std::uint64_t iterator_registrations{0};
+  // Deepest level a node has been inserted at, before rebalancing, the root is at level 1
+  std::size_t max_depth{0};
+};
+
+// Self checks of the tree, see set::validate(). With sampled_validation<Period> every modification
+// checks one root-to-leaf path in O(h) and every Period-th one checks the whole set, both by assert.
+struct no_validation {};
+
+template <std::size_t Period = 1024>
+struct sampled_validation {
+  static_assert(Period > 0);
+};
+
+template <typename V>
+struct validation_period : std::integral_constant<std::size_t, 0> {};
+
+template <std::size_t Period>
+struct validation_period<sampled_validation<Period>> : std::integral_constant<std::size_t, Period> {};
+
+// Node storage policies. With inline_nodes<N> the set object holds room for N nodes and takes
+// them before the allocator, so a set that never grows past N elements allocates nothing. The
+// nodes are ordinary tree nodes wherever they live, the N + 1-th element simply gets a heap node.
+struct heap_nodes {};
+
+template <std::size_t N = 8>
+struct inline_nodes {
+  static_assert(N > 0 && N <= 64, "the free slots are kept in one 64-bit mask");
+};
+
+template <typename S>
+struct inline_node_count : std::integral_constant<std::size_t, 0> {};
+
+template <std::size_t N>
+struct inline_node_count<inline_nodes<N>> : std::integral_constant<std::size_t, N> {};
+
+// What set::validate() checks:
+// path      one root-to-leaf path, the bounds and links of every node on it and the ends of the tree, O(h)
+// structure the whole tree: order, links, size, balance data, subtree sizes and in-order links, O(n log n)
+// full      the structure and every iterator registered in the set, O(n log n + i)
+enum class validation_level { path, structure, full };
+
+// Modification count of a set with sampled validation, an empty base otherwise
+template <bool Enabled>
+class validation_holder {};
+
+template <>
+class validation_holder<true> {
+protected:
+  std::uint64_t changes_{0};
+};
+
+// Stores the counters of a set, an empty base when counting is off
+template <bool Enabled>
+class counters_holder {
+protected:
+  void tally(std::uint64_t set_counters::*, std::uint64_t = 1) const noexcept {}
+
+  void tally_depth(std::size_t) const noexcept {}
+
+  void tally_all(const counters_holder&) const noexcept {}
+};
+
+template <>
+class counters_holder<true> {
+protected:
+  // Lookups are const but still counted
+  mutable set_counters counters_;
+
+  void tally(std::uint64_t set_counters::*counter, std::uint64_t n = 1) const noexcept {
+    counters_.*counter += n;
+  }
+
+  void tally_depth(std::size_t depth) const noexcept {
+    counters_.max_depth = std::max(counters_.max_depth, depth);
+  }
+
+  // Adds the counts of a helper set that worked on behalf of this one
+  void tally_all(const counters_holder& other) const noexcept {
+    counters_.comparisons += other.counters_.comparisons;
+    counters_.searches += other.counters_.searches;
+    counters_.search_steps += other.counters_.search_steps;
+    counters_.iterator_steps += other.counters_.iterator_steps;
+    counters_.node_allocations += other.counters_.node_allocations;
+    counters_.node_frees += other.counters_.node_frees;
+    counters_.iterator_registrations += other.counters_.iterator_registrations;
+    tally_depth(other.counters_.max_depth);
+  }
+};
+
+// Default set configuration. Override single members by inheriting from it:
+//   struct my_policy : default_set_policy { using balance = avl_balance; };
+struct default_set_policy {
+  using balance = red_black_balance;
+  using iterators = tracked_iterators;
+  using order_statistics = no_order_statistics;
+  using traversal = parent_traversal;
+  using counters = no_counters;
+  using validation = no_validation;
+  using storage = heap_nodes;
+};
+
+// Tag for constructors that take sorted input without duplicates
+struct sorted_unique_t {
+  explicit sorted_unique_t() = default;
+};
+
+inline constexpr sorted_unique_t sorted_unique{};
+
+// Header of the binary form that set::serialize writes for trivially copyable T. The elements
+// follow it in sorted order as a raw array, so a file holding it can be mapped and searched
+// in place, see mapped_set.h. Numbers are in the byte order of the writing machine.
+struct set_file_header {
+  static constexpr char expected_magic[8] = {'d', 'e', 'b', 'u', 'g', 's', 'e', 't'};
+  static constexpr std::uint64_t current_version = 1;
+
+  char magic[8];
+  std::uint64_t version;
+  std::uint64_t element_size;
+  std::uint64_t element_align;
+  std::uint64_t count;
+  unsigned char reserved[24];
+
+  template <typename T>
+  static set_file_header describe(std::uint64_t count) noexcept {
+    set_file_header header{};
+    std::copy(std::begin(expected_magic), std::end(expected_magic), header.magic);
+    header.version = current_version;
+    header.element_size = sizeof(T);
+    header.element_align = alignof(T);
+    header.count = count;
+    return header;
+  }
+
+  // Whether the header was written for elements of type T
+  template <typename T>
+  bool describes() const noexcept {
+    return std::equal(std::begin(expected_magic), std::end(expected_magic), magic) && version == current_version &&
+           element_size == sizeof(T) && element_align == alignof(T);
+  }
+};
+
+// The elements start right after the header, which keeps them aligned for any T up to a cache line
+static_assert(sizeof(set_file_header) == 64);
+
+template <typename It>
+using require_input_iterator = std::enable_if_t<
+    std::is_convertible_v<typename std::iterator_traits<It>::iterator_category, std::input_iterator_tag>>;
+
+// Allocators that can free all their memory at once, like arena_allocator
+template <typename A, typename = void>
+struct supports_release : std::false_type {};
+
+template <typename A>
+struct supports_release<
+    A, std::void_t<decltype(std::declval<A&>().release()), decltype(std::declval<const A&>().unique())>>
+    : std::true_type {};
 
+// Strings that the text form of serialize writes as their bytes, without operator<<
 template <typename T>
-class set {
+struct is_char_string : std::false_type {};
+
+template <typename Traits, typename Alloc>
+struct is_char_string<std::basic_string<char, Traits, Alloc>> : std::true_type {};
+
+// Enables the heterogeneous lookup overloads when the comparator declares is_transparent
+template <typename Compare, typename = void>
+struct is_transparent_compare : std::false_type {};
+
+template <typename Compare>
+struct is_transparent_compare<Compare, std::void_t<typename Compare::is_transparent>> : std::true_type {};
+
+// Asks the processor to start loading p, batched lookups overlap their cache misses with it
+inline void prefetch_address(const void* p) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(p);
+#else
+  (void)p;
+#endif
+}
+
+// Keeps the comparator of a container. An empty comparator is stored as a base,
+// so a stateless one takes no space.
+template <typename Compare, bool = std::is_empty_v<Compare> && !std::is_final_v<Compare>>
+class compare_holder {
+  Compare comp_;
+
+public:
+  compare_holder() = default;
+
+  explicit compare_holder(const Compare& comp) : comp_(comp) {}
+
+  const Compare& comp() const noexcept {
+    return comp_;
+  }
+
+  Compare& comp() noexcept {
+    return comp_;
+  }
+};
+
+template <typename Compare>
+class compare_holder<Compare, true> : private Compare {
+public:
+  compare_holder() = default;
+
+  explicit compare_holder(const Compare& comp) : Compare(comp) {}
+
+  const Compare& comp() const noexcept {
+    return *this;
+  }
+
+  Compare& comp() noexcept {
+    return *this;
+  }
+};
+
+// The parallel operations of parallel_set.h
+struct set_parallel;
+
+template <typename T, typename Compare = std::less<T>, typename Allocator = std::allocator<T>,
+          typename Policy = default_set_policy>
+class set : private compare_holder<Compare>,
+            private counters_holder<std::is_same_v<typename Policy::counters, operation_counters>>,
+            private validation_holder<validation_period<typename Policy::validation>::value != 0> {
   class s_iterator;
 
-  struct sentinel_node {
-    sentinel_node* left{nullptr};
-    sentinel_node* right{nullptr};
-    sentinel_node* parent{nullptr};
-    std::vector<s_iterator*> share;
+  using balance = typename Policy::balance;
+  static constexpr bool is_red_black = std::is_same_v<balance, red_black_balance>;
+  static constexpr bool is_avl = std::is_same_v<balance, avl_balance>;
+
+  using statistics = typename Policy::order_statistics;
+  static constexpr bool has_order_statistics = std::is_same_v<statistics, subtree_sizes>;
+
+  static constexpr bool is_tracked = std::is_same_v<typename Policy::iterators, tracked_iterators>;
+  static constexpr bool is_generation_checked =
+      std::is_same_v<typename Policy::iterators, generation_checked_iterators>;
+  static constexpr bool is_checked = is_tracked || is_generation_checked;
+
+  static constexpr bool is_linked = std::is_same_v<typename Policy::traversal, linked_traversal>;
+
+  static constexpr bool is_counted = std::is_same_v<typename Policy::counters, operation_counters>;
+  using counters_holder<is_counted>::tally;
+  using counters_holder<is_counted>::tally_depth;
+
+  static constexpr std::size_t sample_period = validation_period<typename Policy::validation>::value;
+
+  struct sentinel_node;
+  struct tracked_position;
 
-    sentinel_node() noexcept : left(nullptr), right(nullptr), parent(nullptr), share() {}
+  // Head of the intrusive list of iterators pointing at a node
+  struct iterator_list {
+    tracked_position* share{nullptr};
 
-    sentinel_node(sentinel_node* l, sentinel_node* r, sentinel_node* p) : left(l), right(r), parent(p), share() {}
+    iterator_list() noexcept = default;
+    iterator_list(const iterator_list&) = delete;
+    iterator_list& operator=(const iterator_list&) = delete;
 
-    virtual ~sentinel_node() {
-      for (auto it : share) {
+    ~iterator_list() {
+      invalidate_iterators();
+    }
+
+    void invalidate_iterators() noexcept {
+      for (tracked_position* it = share; it;) {
+        tracked_position* next = it->next_;
+        it->uncount();
         it->node_ = nullptr;
+        it->prev_ = nullptr;
+        it->next_ = nullptr;
+        it = next;
+      }
+      share = nullptr;
+    }
+
+    DEBUG_SET_LOCAL_ITERATORS_BEGIN
+    void add_iterator(tracked_position* it) noexcept {
+      it->prev_ = nullptr;
+      it->next_ = share;
+      if (share) {
+        share->prev_ = it;
       }
+      share = it;
     }
+    DEBUG_SET_LOCAL_ITERATORS_END
 
-    void add_iterator(s_iterator* it) {
-      share.push_back(it);
+    void remove_iterator(tracked_position* it) noexcept {
+      if (it->prev_) {
+        it->prev_->next_ = it->next_;
+      } else {
+        share = it->next_;
+      }
+      if (it->next_) {
+        it->next_->prev_ = it->prev_;
+      }
+      it->prev_ = nullptr;
+      it->next_ = nullptr;
     }
 
-    void remove_iterator(s_iterator* it) {
-      auto it_pos = std::find(share.begin(), share.end(), it);
-      if (it_pos != share.end()) {
-        share.erase(it_pos);
+    // Puts to into the place of from in the list
+    void replace_iterator(tracked_position* from, tracked_position* to) noexcept {
+      to->prev_ = from->prev_;
+      to->next_ = from->next_;
+      if (to->prev_) {
+        to->prev_->next_ = to;
+      } else {
+        share = to;
+      }
+      if (to->next_) {
+        to->next_->prev_ = to;
       }
+      from->prev_ = nullptr;
+      from->next_ = nullptr;
+    }
+  };
+
+  struct no_iterator_list {};
+
+  // Stamps of live nodes are even and unique within a set, fake_ has an odd one, 0 marks a dead node
+  struct generation_stamp {
+    std::uintptr_t stamp{0};
+  };
+
+  using iterator_data = std::conditional_t<is_tracked, iterator_list,
+                                           std::conditional_t<is_generation_checked, generation_stamp, no_iterator_list>>;
+
+  // In-order neighbours for linked_traversal. The least node has no previous one,
+  // the greatest is followed by fake_, and fake_ is preceded by it.
+  struct in_order_links {
+    sentinel_node* prev_in_order{nullptr};
+    sentinel_node* next_in_order{nullptr};
+  };
+
+  struct no_in_order_links {};
+
+  // Not polymorphic: nodes are always destroyed as node, the sentinel only as fake_
+  struct sentinel_node : iterator_data,
+                         std::conditional_t<is_linked, in_order_links, no_in_order_links> {
+    sentinel_node* left{nullptr};
+    sentinel_node* right{nullptr};
+    // Parent pointer, for red-black trees the lowest bit is set for red nodes
+    std::uintptr_t parent_{0};
+
+    sentinel_node() noexcept = default;
+
+    sentinel_node(sentinel_node* l, sentinel_node* r, sentinel_node* p) noexcept
+        : left(l), right(r), parent_(reinterpret_cast<std::uintptr_t>(p)) {}
+
+    sentinel_node* parent() const noexcept {
+      return reinterpret_cast<sentinel_node*>(parent_ & ~std::uintptr_t(1));
+    }
+
+    void set_parent(sentinel_node* p) noexcept {
+      parent_ = reinterpret_cast<std::uintptr_t>(p) | (parent_ & 1);
+    }
+
+    bool red() const noexcept {
+      return parent_ & 1;
     }
 
-    friend void swap_shared(s_iterator* lhs, s_iterator* rhs) {
-      auto it1 = std::find(lhs->node_->share.begin(), lhs->node_->share.end(), lhs);
-      auto it2 = std::find(rhs->node_->share.begin(), rhs->node_->share.end(), rhs);
-      std::iter_swap(it1, it2);
+    void set_red(bool red) noexcept {
+      parent_ = (parent_ & ~std::uintptr_t(1)) | static_cast<std::uintptr_t>(red);
     }
 
     friend void swap(sentinel_node& lhs, sentinel_node& rhs) noexcept {
       std::swap(lhs.left, rhs.left);
       std::swap(lhs.right, rhs.right);
-      std::swap(lhs.parent, rhs.parent);
+      std::swap(lhs.parent_, rhs.parent_);
+    }
+  };
+
+  static_assert(alignof(sentinel_node) > 1, "the color bit needs aligned nodes");
+  static_assert(!std::is_polymorphic_v<sentinel_node>);
+  static_assert(sizeof(sentinel_node) == ((is_checked ? 4 : 3) + (is_linked ? 2 : 0)) * sizeof(void*));
+
+  // Where a tracked iterator points. It stays in the list of its node,
+  // so destroying the node invalidates the iterator.
+  struct tracked_position {
+    sentinel_node* node_{nullptr};
+    const set* container_{nullptr};
+    tracked_position* prev_{nullptr};
+    tracked_position* next_{nullptr};
+
+    tracked_position() noexcept = default;
+
+    tracked_position(sentinel_node* node, const set* container) noexcept : node_(node), container_(container) {
+      append_to_node();
+    }
+
+    tracked_position(const tracked_position& other) noexcept : node_(other.node_), container_(other.container_) {
+      append_to_node();
+    }
+
+    // Moving takes over the place of other in the list of its node and leaves other singular
+    tracked_position(tracked_position&& other) noexcept : node_(other.node_), container_(other.container_) {
+      take_place_of(other);
+    }
+
+    tracked_position& operator=(const tracked_position& other) noexcept {
+      if (this == &other) {
+        return *this;
+      }
+      if (node_ != other.node_) {
+        // Off the old node first, it is counted by the old container
+        remove_from_node();
+        node_ = other.node_;
+        container_ = other.container_;
+        append_to_node();
+      } else {
+        container_ = other.container_;
+      }
+      return *this;
+    }
+
+    tracked_position& operator=(tracked_position&& other) noexcept {
+      if (this == &other) {
+        return *this;
+      }
+      remove_from_node();
+      node_ = other.node_;
+      container_ = other.container_;
+      take_place_of(other);
+      return *this;
+    }
+
+    ~tracked_position() {
+      remove_from_node();
+    }
+
+    bool belongs_to(const set* container) const noexcept {
+      return container_ == container;
+    }
+
+    // The iterators at elements, not at end(), are counted by their container
+    bool at_element() const noexcept {
+      return node_ && node_ != &container_->fake_;
+    }
+
+    void count() const noexcept {
+      if (at_element()) {
+        ++container_->element_iterators_;
+      }
+    }
+
+    void uncount() const noexcept {
+      if (at_element()) {
+        --container_->element_iterators_;
+      }
+    }
+
+    void append_to_node() noexcept {
+      if (node_) {
+        node_->add_iterator(this);
+        count();
+        container_->tally(&set_counters::iterator_registrations);
+      }
+    }
+
+    void remove_from_node() noexcept {
+      if (node_) {
+        node_->remove_iterator(this);
+        uncount();
+      }
+    }
+
+    void take_place_of(tracked_position& other) noexcept {
+      if (node_) {
+        node_->replace_iterator(&other, this);
+      }
+      other.node_ = nullptr;
+    }
+
+    void move_to_another_node(sentinel_node* new_node) noexcept {
+      if (node_ == new_node) {
+        return;
+      }
+      remove_from_node();
+      node_ = new_node;
+      append_to_node();
+    }
+
+    friend void swap(tracked_position& left, tracked_position& right) noexcept {
+      left.remove_from_node();
+      right.remove_from_node();
+      std::swap(left.container_, right.container_);
+      std::swap(left.node_, right.node_);
+      left.append_to_node();
+      right.append_to_node();
+    }
+  };
+
+  // Where an unchecked iterator points: nothing but the node, trivially copyable
+  struct bare_position {
+    sentinel_node* node_{nullptr};
+
+    bare_position() noexcept = default;
+
+    bare_position(sentinel_node* node, const set*) noexcept : node_(node) {}
+
+    bool belongs_to(const set*) const noexcept {
+      return true;
+    }
+
+    void move_to_another_node(sentinel_node* new_node) noexcept {
+      node_ = new_node;
+    }
+  };
+
+  // Where a generation checked iterator points: the node and its stamp at that time.
+  // Trivially copyable, the container is not known, so belonging to it is not checked.
+  struct stamped_position {
+    sentinel_node* node_{nullptr};
+    std::uintptr_t stamp_{0};
+
+    stamped_position() noexcept = default;
+
+    stamped_position(sentinel_node* node, const set*) noexcept : node_(node), stamp_(node ? node->stamp : 0) {}
+
+    bool belongs_to(const set*) const noexcept {
+      return true;
+    }
+
+    void move_to_another_node(sentinel_node* new_node) noexcept {
+      node_ = new_node;
+      stamp_ = new_node ? new_node->stamp : 0;
     }
   };
 
-  struct node : sentinel_node {
-    const T value_;
+  using iterator_position =
+      std::conditional_t<is_tracked, tracked_position,
+                         std::conditional_t<is_generation_checked, stamped_position, bare_position>>;
 
-    node(sentinel_node* l, sentinel_node* r, sentinel_node* p, const T& v) : sentinel_node(l, r, p), value_(v) {}
+  // Statistics and balance data follow the links, so a small T can share the padding after them
+  struct node : sentinel_node, statistics::node_data, balance::node_data {
+    // Only a node handle changes it, while the node is outside of any tree
+    T value_;
 
-    node(sentinel_node* p, const T& v) : node(nullptr, nullptr, p, v) {}
+    template <typename... Args>
+    explicit node(sentinel_node* p, Args&&... args)
+        : sentinel_node(nullptr, nullptr, p), value_(std::forward<Args>(args)...) {}
   };
 
-  class s_iterator {
+  static constexpr std::size_t round_up(std::size_t n, std::size_t align) noexcept {
+    return (n + align - 1) / align * align;
+  }
+
+  static constexpr std::size_t statistics_size =
+      std::is_empty_v<typename statistics::node_data> ? 0 : sizeof(typename statistics::node_data);
+
+  // The links, the subtree size if any, at most one byte of balance data and T at its alignment,
+  // see the table in README
+  static constexpr std::size_t max_node_size =
+      round_up(round_up(sizeof(sentinel_node) + statistics_size + 1, alignof(T)) + sizeof(T), alignof(node));
+  static_assert(sizeof(node) <= max_node_size);
+
+  using node_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<node>;
+  using node_traits = std::allocator_traits<node_allocator>;
+
+  static_assert(std::is_same_v<typename node_traits::pointer, node*>, "fancy pointers are not supported");
+
+  class s_iterator : private iterator_position {
   public:
     using iterator_category = std::bidirectional_iterator_tag;
     using difference_type = std::ptrdiff_t;
-    using value_type = bool;
+    using value_type = T;
     using reference = const T&;
     using pointer = const T*;
 
   private:
-    sentinel_node* node_;
-    const set* container_;
-
-    s_iterator(sentinel_node* node, const set* container) : node_(node), container_(container) {
-      append_to_node();
-    }
+    using iterator_position::node_;
+    using iterator_position::belongs_to;
+    using iterator_position::move_to_another_node;
 
-    void append_to_node() {
-      try {
-        if (node_) {
-          node_->add_iterator(this);
-        }
-      } catch (...) {
-        node_ = nullptr;
-        throw;
-      }
-    }
+    s_iterator(sentinel_node* node, const set* container) noexcept : iterator_position(node, container) {}
 
     static sentinel_node* find_min(sentinel_node* node) {
       auto current = node;
@@ -100,14 +696,42 @@ class set {
       return current;
     }
 
+    // nullptr for the first element
+    static sentinel_node* find_prev(sentinel_node* node) {
+      if constexpr (is_linked) {
+        return node->prev_in_order;
+      }
+      return walk_prev(node);
+    }
+
     static sentinel_node* find_next(sentinel_node* node) {
+      if constexpr (is_linked) {
+        return node->next_in_order;
+      }
+      return walk_next(node);
+    }
+
+    // The same by parent pointers, O(h)
+    static sentinel_node* walk_prev(sentinel_node* node) {
+      if (node->left) {
+        return find_max(node->left);
+      }
+      sentinel_node* parent = node->parent();
+      while (parent && node == parent->left) {
+        node = parent;
+        parent = parent->parent();
+      }
+      return parent;
+    }
+
+    static sentinel_node* walk_next(sentinel_node* node) {
       if (node->right) {
         return find_min(node->right);
       }
-      sentinel_node* parent = node->parent;
+      sentinel_node* parent = node->parent();
       while (parent && node == parent->right) {
         node = parent;
-        parent = parent->parent;
+        parent = parent->parent();
       }
       return parent;
     }
@@ -115,60 +739,44 @@ class set {
     friend set;
 
     void base_assert() const {
-      assert(node_ && node_->left != node_);
-    }
-
-    void move_to_another_node(sentinel_node* new_node) {
-      try {
-        std::swap(node_, new_node);
-        if (node_) {
-          node_->add_iterator(this);
-        }
-      } catch (...) {
-        std::swap(node_, new_node);
-        throw;
+      assert(node_);
+      if constexpr (is_generation_checked) {
+        assert(node_->stamp == this->stamp_);
       }
-      if (new_node) {
-        new_node->remove_iterator(this);
-      }
-    }
-
-  public:
-    s_iterator() : node_(nullptr), container_(nullptr) {}
-
-    s_iterator(const s_iterator& other) : node_(other.node_), container_(other.container_) {
-      append_to_node();
     }
 
-    s_iterator& operator=(const s_iterator& other) {
-      if (this == &other) {
-        return *this;
+    // Unchecked iterators do not know their container or stamp, end() is only caught by checked ones
+    void end_assert() const {
+      base_assert();
+      if constexpr (is_tracked) {
+        assert(node_ != &this->container_->fake_);
+      } else if constexpr (is_generation_checked) {
+        assert(!(this->stamp_ & 1));
       }
-      container_ = other.container_;
-      move_to_another_node(other.node_);
-      return *this;
     }
 
-    ~s_iterator() {
-      if (node_) {
-        node_->remove_iterator(this);
+    void count_step() const noexcept {
+      if constexpr (is_tracked && is_counted) {
+        this->container_->tally(&set_counters::iterator_steps);
       }
     }
 
-    // s_iterator(const s_iterator& other) = default;
+  public:
+    s_iterator() noexcept = default;
 
     reference operator*() const {
-      base_assert();
+      end_assert();
       return static_cast<node*>(node_)->value_;
     }
 
     pointer operator->() const noexcept {
-      base_assert();
+      end_assert();
       return &(static_cast<node*>(node_)->value_);
     }
 
     s_iterator& operator++() {
-      base_assert();
+      end_assert();
+      count_step();
       sentinel_node* new_node = find_next(node_);
       move_to_another_node(new_node);
       return *this;
@@ -182,18 +790,8 @@ class set {
 
     s_iterator& operator--() {
       base_assert();
-      sentinel_node* new_node = node_;
-      if (new_node->left != nullptr) {
-        new_node = find_max(node_->left);
-      } else {
-        sentinel_node* parent = new_node->parent;
-        while (parent != nullptr && new_node == parent->left) {
-          new_node = parent;
-          parent = parent->parent;
-        }
-        new_node = parent;
-      }
-      move_to_another_node(new_node);
+      count_step();
+      move_to_another_node(find_prev(node_));
       base_assert();
       return *this;
     }
@@ -205,8 +803,10 @@ class set {
     }
 
     friend bool operator==(const s_iterator& left, const s_iterator& right) {
-      assert(left.container_ == right.container_);
-      assert(left.container_);
+      if constexpr (is_tracked) {
+        assert(left.container_ == right.container_);
+        assert(left.container_);
+      }
       return left.node_ == right.node_;
     }
 
@@ -214,153 +814,2224 @@ class set {
       return !(left == right);
     }
 
-    friend void swap(s_iterator& left, s_iterator& right) {
-      sentinel_node* left_node = left.node_;
-      sentinel_node* right_node = right.node_;
-      std::swap(left.container_, right.container_);
-      std::swap(left.node_, right.node_);
-
-      for (auto it : left_node->share) {
-        it->node_ = left_node;
-      }
-      for (auto it : right_node->share) {
-        it->node_ = right_node;
-      }
+    friend void swap(s_iterator& left, s_iterator& right) noexcept {
+      using std::swap;
+      swap(static_cast<iterator_position&>(left), static_cast<iterator_position&>(right));
     }
   };
 
-public:
-  using value_type = T;
-
-  using reference = T&;
-  using const_reference = const T&;
-
-  using pointer = T*;
-  using const_pointer = const T*;
+  // Owns a node extracted from a set until it is inserted into a set again
+  class node_handle {
+    node* node_{nullptr};
+    std::optional<node_allocator> alloc_;
 
-  using iterator = s_iterator;
-  using const_iterator = s_iterator;
+    node_handle(node* n, const node_allocator& alloc) noexcept : node_(n), alloc_(alloc) {}
 
-  using reverse_iterator = std::reverse_iterator<iterator>;
-  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+    node* release() noexcept {
+      node* n = node_;
+      node_ = nullptr;
+      alloc_.reset();
+      return n;
+    }
 
-private:
-  sentinel_node fake_;
-  std::size_t size_{0};
+    void reset() noexcept {
+      if (node_) {
+        node_traits::destroy(*alloc_, node_);
+        node_traits::deallocate(*alloc_, node_, 1);
+      }
+      release();
+    }
 
-  sentinel_node* take_root() const {
-    return fake_.left;
-  }
+    friend set;
 
-  sentinel_node* take_root() {
-    return fake_.left;
-  }
+  public:
+    using value_type = T;
+    using allocator_type = Allocator;
 
-  void put_root(sentinel_node* node) {
-    fake_.left = node;
-  }
+    constexpr node_handle() noexcept = default;
 
-  sentinel_node* copy_tree(sentinel_node* other_root) {
-    if (!other_root) {
-      return nullptr;
+    node_handle(node_handle&& other) noexcept : node_(other.node_), alloc_(std::move(other.alloc_)) {
+      other.release();
     }
 
-    sentinel_node* new_node = nullptr;
-    try {
-      new_node = new node(nullptr, static_cast<node*>(other_root)->value_);
-
-      if (other_root->left) {
-        new_node->left = copy_tree(other_root->left);
-        new_node->left->parent = new_node;
-      }
-      if (other_root->right) {
-        new_node->right = copy_tree(other_root->right);
-        new_node->right->parent = new_node;
+    node_handle& operator=(node_handle&& other) noexcept {
+      if (this != &other) {
+        reset();
+        node_ = other.node_;
+        alloc_ = std::move(other.alloc_);
+        other.release();
       }
-    } catch (...) {
-      del_subtree(new_node);
-      throw;
+      return *this;
     }
-    return new_node;
-  }
 
-  static sentinel_node* find(sentinel_node* root, const T& val) {
-    if (root == nullptr || static_cast<node*>(root)->value_ == val) {
-      return root;
+    ~node_handle() {
+      reset();
     }
 
-    if (val < static_cast<node*>(root)->value_) {
-      return find(root->left, val);
+    bool empty() const noexcept {
+      return node_ == nullptr;
     }
 
-    return find(root->right, val);
-  }
-
-  sentinel_node* merge(sentinel_node* left, sentinel_node* right) {
-    if (!left) {
-      return right;
-    }
-    if (!right) {
-      return left;
+    explicit operator bool() const noexcept {
+      return node_ != nullptr;
     }
 
-    sentinel_node* min_right = s_iterator::find_min(right);
-    if (min_right == right) {
-      min_right->left = left;
-      left->parent = min_right;
-      return right;
+    // The element may be changed freely while it is outside of any set
+    value_type& value() const noexcept {
+      assert(node_);
+      return node_->value_;
     }
 
-    if (min_right->parent->left == min_right) {
-      min_right->parent->left = min_right->right;
-      if (min_right->right) {
-        min_right->right->parent = min_right->parent;
-      }
-    } else {
-      min_right->parent->right = min_right->right;
-      if (min_right->right) {
-        min_right->right->parent = min_right->parent;
-      }
+    allocator_type get_allocator() const {
+      assert(alloc_);
+      return allocator_type(*alloc_);
     }
 
-    min_right->left = left;
-    min_right->right = right;
-    if (left) {
-      left->parent = min_right;
+    friend void swap(node_handle& lhs, node_handle& rhs) noexcept {
+      std::swap(lhs.node_, rhs.node_);
+      std::swap(lhs.alloc_, rhs.alloc_);
     }
-    if (right) {
-      right->parent = min_right;
+  };
+
+  // Read-only range of a set walked by bare node pointers, so iterating it registers nothing.
+  // The set must not change while a view of it exists: with tracked_iterators the set counts
+  // its views, as it does with generation_checked_iterators, and any modification aborts.
+  class s_view {
+    sentinel_node* first_{nullptr};
+    sentinel_node* last_{nullptr};
+    const set* container_{nullptr};
+
+    s_view(sentinel_node* first, sentinel_node* last, const set* container) noexcept
+        : first_(first), last_(last), container_(container) {
+      attach();
     }
 
-    return min_right;
+    void attach() const noexcept {
+      if constexpr (is_checked) {
+        if (container_) {
+          ++container_->views_;
+        }
+      }
+    }
+
+    void detach() const noexcept {
+      if constexpr (is_checked) {
+        if (container_) {
+          --container_->views_;
+        }
+      }
+    }
+
+    friend set;
+
+  public:
+    // Not checked in any mode, a cursor is only a node pointer
+    class cursor {
+      sentinel_node* node_{nullptr};
+
+      explicit cursor(sentinel_node* node) noexcept : node_(node) {}
+
+      friend s_view;
+
+    public:
+      using iterator_category = std::bidirectional_iterator_tag;
+      using difference_type = std::ptrdiff_t;
+      using value_type = T;
+      using reference = const T&;
+      using pointer = const T*;
+
+      cursor() noexcept = default;
+
+      reference operator*() const noexcept {
+        return value(node_);
+      }
+
+      pointer operator->() const noexcept {
+        return &value(node_);
+      }
+
+      cursor& operator++() noexcept {
+        node_ = s_iterator::find_next(node_);
+        return *this;
+      }
+
+      cursor operator++(int) noexcept {
+        cursor tmp = *this;
+        ++*this;
+        return tmp;
+      }
+
+      cursor& operator--() noexcept {
+        node_ = s_iterator::find_prev(node_);
+        return *this;
+      }
+
+      cursor operator--(int) noexcept {
+        cursor tmp = *this;
+        --*this;
+        return tmp;
+      }
+
+      friend bool operator==(cursor left, cursor right) noexcept {
+        return left.node_ == right.node_;
+      }
+
+      friend bool operator!=(cursor left, cursor right) noexcept {
+        return left.node_ != right.node_;
+      }
+    };
+
+    s_view() noexcept = default;
+
+    s_view(const s_view& other) noexcept : first_(other.first_), last_(other.last_), container_(other.container_) {
+      attach();
+    }
+
+    s_view& operator=(const s_view& other) noexcept {
+      other.attach();
+      detach();
+      first_ = other.first_;
+      last_ = other.last_;
+      container_ = other.container_;
+      return *this;
+    }
+
+    ~s_view() {
+      detach();
+    }
+
+    cursor begin() const noexcept {
+      return cursor(first_);
+    }
+
+    cursor end() const noexcept {
+      return cursor(last_);
+    }
+
+    bool empty() const noexcept {
+      return first_ == last_;
+    }
+  };
+
+public:
+  using key_type = T;
+  using value_type = T;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using allocator_type = Allocator;
+
+  using reference = T&;
+  using const_reference = const T&;
+
+  using pointer = T*;
+  using const_pointer = const T*;
+
+  using iterator = s_iterator;
+  using const_iterator = s_iterator;
+
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  using node_type = node_handle;
+
+  using view_type = s_view;
+
+  struct insert_return_type {
+    iterator position;
+    bool inserted;
+    node_type node;
+  };
+
+  // Bytes taken by one element
+  static constexpr std::size_t node_size = sizeof(node);
+
+private:
+  static constexpr std::size_t inline_capacity = inline_node_count<typename Policy::storage>::value;
+  // Inline nodes move between sets without allocating, so only T can make it throw
+  static constexpr bool nothrow_inline_moves = inline_capacity == 0 || std::is_nothrow_move_constructible_v<T>;
+
+  // Room for the first inline_capacity nodes, with a bit set in used for every slot taken
+  struct inline_pool {
+    alignas(node) unsigned char slots[inline_capacity * sizeof(node)];
+    std::uint64_t used{0};
+
+    inline_pool() noexcept {}
+    inline_pool(const inline_pool&) = delete;
+    inline_pool& operator=(const inline_pool&) = delete;
+
+    node* slot(std::size_t i) noexcept {
+      return reinterpret_cast<node*>(slots + i * sizeof(node));
+    }
+
+    bool owns(const sentinel_node* n) const noexcept {
+      auto address = reinterpret_cast<std::uintptr_t>(n);
+      auto first = reinterpret_cast<std::uintptr_t>(slots);
+      return address - first < sizeof(slots);
+    }
+
+    std::size_t free_slots() const noexcept {
+      std::size_t count = 0;
+      for (std::size_t i = 0; i < inline_capacity; ++i) {
+        count += !(used >> i & 1);
+      }
+      return count;
+    }
+
+    // nullptr when every slot is taken
+    node* take() noexcept {
+      for (std::size_t i = 0; i < inline_capacity; ++i) {
+        if (!(used >> i & 1)) {
+          used |= std::uint64_t(1) << i;
+          return slot(i);
+        }
+      }
+      return nullptr;
+    }
+
+    void give_back(const sentinel_node* n) noexcept {
+      std::size_t i = (reinterpret_cast<const unsigned char*>(n) - slots) / sizeof(node);
+      used &= ~(std::uint64_t(1) << i);
+    }
+  };
+
+  struct no_inline_pool {
+    bool owns(const sentinel_node*) const noexcept {
+      return false;
+    }
+  };
+
+  // fake_ carries the inline nodes, so without them it stays a bare sentinel.
+  // Swapping two headers swaps the sentinels only, the slots stay where they are.
+  struct header : sentinel_node, std::conditional_t<(inline_capacity > 0), inline_pool, no_inline_pool> {};
+
+  header fake_;
+  sentinel_node* leftmost_{nullptr};
+  sentinel_node* rightmost_{nullptr};
+  std::size_t size_{0};
+  node_allocator alloc_;
+  // Live views, counted in the checked iterator modes only
+  mutable std::size_t views_{0};
+  // Tracked iterators at the elements of this set. Without any, swap does not walk the nodes
+  // to point their iterators at the other set, so moving a set nobody iterates is O(1).
+  mutable std::size_t element_iterators_{0};
+  // The last node stamp with generation_checked_iterators, 0 before the first node
+  std::uintptr_t next_stamp_{0};
+
+  // Every primitive that changes the tree checks that no view is watching it
+  void modify_assert() const noexcept {
+    if constexpr (is_checked) {
+      assert(views_ == 0);
+    }
+  }
+
+  // Takes a free inline slot if there is one, a heap node otherwise
+  template <typename... Args>
+  node* create_node(Args&&... args) {
+    if constexpr (inline_capacity > 0) {
+      if (node* slot = fake_.take()) {
+        try {
+          node_traits::construct(alloc_, slot, std::forward<Args>(args)...);
+        } catch (...) {
+          fake_.give_back(slot);
+          throw;
+        }
+        restamp(slot);
+        return slot;
+      }
+    }
+    return create_heap_node(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  node* create_heap_node(Args&&... args) {
+    node* new_node = node_traits::allocate(alloc_, 1);
+    try {
+      node_traits::construct(alloc_, new_node, std::forward<Args>(args)...);
+    } catch (...) {
+      node_traits::deallocate(alloc_, new_node, 1);
+      throw;
+    }
+    restamp(new_node);
+    tally(&set_counters::node_allocations);
+    return new_node;
+  }
+
+  static constexpr unsigned stamp_count_bits = 4 * sizeof(std::uintptr_t);
+  static constexpr std::uintptr_t stamp_count_mask = (std::uintptr_t(1) << stamp_count_bits) - 1;
+
+  // Range 0 is never handed out, so a set whose next_stamp_ is 0 has none yet
+  static std::uintptr_t take_stamp_range() noexcept {
+    std::uintptr_t range = generation_ranges.fetch_add(1, std::memory_order_relaxed) + 1;
+    assert(range >> stamp_count_bits == 0 && "the generation stamp ranges are used up");
+    return range << stamp_count_bits;
+  }
+
+  // Gives n a new stamp, which invalidates the generation checked iterators pointing at it
+  void restamp(sentinel_node* n) noexcept {
+    if constexpr (is_generation_checked) {
+      next_stamp_ += 2;
+      // The first stamp of this set, or the count has run into the next range
+      if (next_stamp_ == 2 || (next_stamp_ & stamp_count_mask) == 0) {
+        next_stamp_ = take_stamp_range() + 2;
+      }
+      n->stamp = next_stamp_;
+    }
+  }
+
+  // The store is volatile: right before a destructor ends, a plain one is dead to the compiler
+  // and dropped (-flifetime-dse), while the iterators still read the stamp
+  static void kill_stamp(sentinel_node* n) noexcept {
+    if constexpr (is_generation_checked) {
+      *static_cast<volatile std::uintptr_t*>(&n->stamp) = 0;
+    }
+  }
+
+  // Destroys the element and the node, then writes the dead stamp into the memory they leave,
+  // which stays allocated until the caller frees it. A stamp killed before the destructor would
+  // be a store into an object about to end, and the compiler drops it.
+  void destroy_value(node* n) noexcept {
+    if constexpr (is_generation_checked) {
+      void* stamp = &n->stamp;
+      node_traits::destroy(alloc_, n);
+      *static_cast<volatile std::uintptr_t*>(::new (stamp) std::uintptr_t) = 0;
+    } else {
+      node_traits::destroy(alloc_, n);
+    }
+  }
+
+  void destroy_node(sentinel_node* d_node) noexcept {
+    node* n = static_cast<node*>(d_node);
+    destroy_value(n);
+    if (!release_slot(n)) {
+      node_traits::deallocate(alloc_, n, 1);
+      tally(&set_counters::node_frees);
+    }
+  }
+
+  // Returns the slot of an inline node to the pool, false for a heap node
+  bool release_slot(sentinel_node* n) noexcept {
+    if constexpr (inline_capacity > 0) {
+      if (fake_.owns(n)) {
+        fake_.give_back(n);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  sentinel_node* take_root() const {
+    return fake_.left;
+  }
+
+  sentinel_node* take_root() {
+    return fake_.left;
+  }
+
+  void put_root(sentinel_node* node) {
+    fake_.left = node;
+  }
+
+  // Walks the source tree by parent pointers, so the stack depth does not depend on its height
+  sentinel_node* copy_tree(const sentinel_node* other_root) {
+    sentinel_node* new_root = create_node(nullptr, value(other_root));
+    copy_node_data(new_root, other_root);
+
+    try {
+      const sentinel_node* from = other_root;
+      sentinel_node* to = new_root;
+      while (true) {
+        if (from->left && !to->left) {
+          from = from->left;
+          to->left = create_node(to, value(from));
+          to = to->left;
+          copy_node_data(to, from);
+        } else if (from->right && !to->right) {
+          from = from->right;
+          to->right = create_node(to, value(from));
+          to = to->right;
+          copy_node_data(to, from);
+        } else if (from != other_root) {
+          from = from->parent();
+          to = to->parent();
+        } else {
+          break;
+        }
+      }
+    } catch (...) {
+      del_subtree(new_root);
+      throw;
+    }
+    return new_root;
+  }
+
+  using compare_holder<Compare>::comp;
+
+  // Every comparison of elements goes through here, so that it can be counted
+  template <typename A, typename B>
+  bool less(const A& a, const B& b) const {
+    tally(&set_counters::comparisons);
+    return comp()(a, b);
+  }
+
+  void count_search(std::uint64_t steps) const noexcept {
+    tally(&set_counters::searches);
+    tally(&set_counters::search_steps, steps);
+  }
+
+  // One comparison per level: the lower bound is the only candidate for an equivalent element
+  template <typename K>
+  sentinel_node* find_node(const K& key) const {
+    sentinel_node* result = lower_bound_node(key);
+    return result && !less(key, value(result)) ? result : nullptr;
+  }
+
+  template <typename K>
+  sentinel_node* lower_bound_node(const K& key) const {
+    sentinel_node* current = take_root();
+    sentinel_node* result = nullptr;
+    std::uint64_t steps = 0;
+    while (current) {
+      ++steps;
+      if (!less(value(current), key)) {
+        result = current;
+        current = current->left;
+      } else {
+        current = current->right;
+      }
+    }
+    count_search(steps);
+    return result;
+  }
+
+  template <typename K>
+  sentinel_node* upper_bound_node(const K& key) const {
+    sentinel_node* current = take_root();
+    sentinel_node* result = nullptr;
+    std::uint64_t steps = 0;
+    while (current) {
+      ++steps;
+      if (less(key, value(current))) {
+        result = current;
+        current = current->left;
+      } else {
+        current = current->right;
+      }
+    }
+    count_search(steps);
+    return result;
+  }
+
+  // Number of elements less than key
+  template <typename K>
+  std::size_t rank_of(const K& key) const {
+    static_assert(has_order_statistics, "rank needs the subtree_sizes order statistics policy");
+    std::size_t rank = 0;
+    sentinel_node* current = take_root();
+    std::uint64_t steps = 0;
+    while (current) {
+      ++steps;
+      if (less(value(current), key)) {
+        rank += subtree_size(current->left) + 1;
+        current = current->right;
+      } else {
+        current = current->left;
+      }
+    }
+    count_search(steps);
+    return rank;
+  }
+
+  sentinel_node* end_node() const noexcept {
+    return const_cast<sentinel_node*>(static_cast<const sentinel_node*>(&fake_));
+  }
+
+  const_iterator node_or_end(sentinel_node* n) const {
+    return n ? const_iterator(n, this) : end();
+  }
+
+  using node_data = typename balance::node_data;
+
+  static const T& value(const sentinel_node* n) noexcept {
+    return static_cast<const node*>(n)->value_;
+  }
+
+  static bool is_red(const sentinel_node* n) noexcept {
+    return n && n->red();
+  }
+
+  static int height(const sentinel_node* n) noexcept {
+    return n ? static_cast<const node*>(n)->height : 0;
+  }
+
+  static void update_height(sentinel_node* n) noexcept {
+    static_cast<node*>(n)->height = static_cast<unsigned char>(std::max(height(n->left), height(n->right)) + 1);
+  }
+
+  static std::size_t subtree_size(const sentinel_node* n) noexcept {
+    return n ? static_cast<const node*>(n)->subtree_size : 0;
+  }
+
+  static void update_size(sentinel_node* n) noexcept {
+    static_cast<node*>(n)->subtree_size = subtree_size(n->left) + subtree_size(n->right) + 1;
+  }
+
+  // Adds delta to the subtree sizes of n and all its ancestors
+  void adjust_sizes(sentinel_node* n, std::size_t delta) noexcept {
+    for (; n != &fake_; n = n->parent()) {
+      static_cast<node*>(n)->subtree_size += delta;
+    }
+  }
+
+  using statistics_data = typename statistics::node_data;
+
+  // Balance and statistics data describe the position in the tree, so they are copied and
+  // swapped together with it
+  static void copy_node_data(sentinel_node* to, const sentinel_node* from) noexcept {
+    static_cast<node_data&>(*static_cast<node*>(to)) = *static_cast<const node*>(from);
+    static_cast<statistics_data&>(*static_cast<node*>(to)) = *static_cast<const node*>(from);
+    to->set_red(from->red());
+  }
+
+  static void swap_node_data(sentinel_node* a, sentinel_node* b) noexcept {
+    std::swap(static_cast<node_data&>(*static_cast<node*>(a)), static_cast<node_data&>(*static_cast<node*>(b)));
+    std::swap(static_cast<statistics_data&>(*static_cast<node*>(a)),
+              static_cast<statistics_data&>(*static_cast<node*>(b)));
+    bool a_red = a->red();
+    a->set_red(b->red());
+    b->set_red(a_red);
+  }
+
+  // fake_ is the parent of the root and keeps it as its left child, so it needs no special case
+  static void replace_child(sentinel_node* parent, sentinel_node* old_child, sentinel_node* new_child) noexcept {
+    if (parent->left == old_child) {
+      parent->left = new_child;
+    } else {
+      parent->right = new_child;
+    }
+  }
+
+  static sentinel_node* rotate_left(sentinel_node* x) noexcept {
+    sentinel_node* y = x->right;
+    x->right = y->left;
+    if (y->left) {
+      y->left->set_parent(x);
+    }
+    replace_child(x->parent(), x, y);
+    y->set_parent(x->parent());
+    y->left = x;
+    x->set_parent(y);
+    if constexpr (is_avl) {
+      update_height(x);
+      update_height(y);
+    }
+    if constexpr (has_order_statistics) {
+      update_size(x);
+      update_size(y);
+    }
+    return y;
+  }
+
+  static sentinel_node* rotate_right(sentinel_node* x) noexcept {
+    sentinel_node* y = x->left;
+    x->left = y->right;
+    if (y->right) {
+      y->right->set_parent(x);
+    }
+    replace_child(x->parent(), x, y);
+    y->set_parent(x->parent());
+    y->right = x;
+    x->set_parent(y);
+    if constexpr (is_avl) {
+      update_height(x);
+      update_height(y);
+    }
+    if constexpr (has_order_statistics) {
+      update_size(x);
+      update_size(y);
+    }
+    return y;
+  }
+
+  // Exchanges the tree positions of a and b, where b is the minimum of a's right subtree.
+  // Nodes are relinked rather than values swapped, so iterators stay on their elements.
+  static void swap_with_successor(sentinel_node* a, sentinel_node* b) noexcept {
+    sentinel_node* a_parent = a->parent();
+    sentinel_node* b_parent = b->parent();
+    sentinel_node* b_right = b->right;
+
+    replace_child(a_parent, a, b);
+    b->set_parent(a_parent);
+    b->left = a->left;
+    b->left->set_parent(b);
+    if (b_parent == a) {
+      b->right = a;
+      a->set_parent(b);
+    } else {
+      b->right = a->right;
+      b->right->set_parent(b);
+      b_parent->left = a;
+      a->set_parent(b_parent);
+    }
+    a->left = nullptr;
+    a->right = b_right;
+    if (b_right) {
+      b_right->set_parent(a);
+    }
+    swap_node_data(a, b);
+  }
+
+  static sentinel_node* avl_rebalance(sentinel_node* n) noexcept {
+    int factor = height(n->left) - height(n->right);
+    if (factor > 1) {
+      if (height(n->left->left) < height(n->left->right)) {
+        rotate_left(n->left);
+      }
+      return rotate_right(n);
+    }
+    if (factor < -1) {
+      if (height(n->right->right) < height(n->right->left)) {
+        rotate_right(n->right);
+      }
+      return rotate_left(n);
+    }
+    update_height(n);
+    return n;
+  }
+
+  // Walks up from n until a subtree keeps its previous height
+  void avl_retrace(sentinel_node* n) noexcept {
+    while (n != &fake_) {
+      int old_height = height(n);
+      n = avl_rebalance(n);
+      if (height(n) == old_height) {
+        return;
+      }
+      n = n->parent();
+    }
+  }
+
+  void red_black_insert_fixup(sentinel_node* x) noexcept {
+    x->set_red(true);
+    // fake_ is black, so the loop never climbs above the root
+    while (x->parent()->red()) {
+      sentinel_node* p = x->parent();
+      sentinel_node* g = p->parent();
+      if (p == g->left) {
+        sentinel_node* uncle = g->right;
+        if (is_red(uncle)) {
+          p->set_red(false);
+          uncle->set_red(false);
+          g->set_red(true);
+          x = g;
+          continue;
+        }
+        if (x == p->right) {
+          x = p;
+          rotate_left(x);
+          p = x->parent();
+        }
+        p->set_red(false);
+        g->set_red(true);
+        rotate_right(g);
+      } else {
+        sentinel_node* uncle = g->left;
+        if (is_red(uncle)) {
+          p->set_red(false);
+          uncle->set_red(false);
+          g->set_red(true);
+          x = g;
+          continue;
+        }
+        if (x == p->left) {
+          x = p;
+          rotate_right(x);
+          p = x->parent();
+        }
+        p->set_red(false);
+        g->set_red(true);
+        rotate_left(g);
+      }
+    }
+    take_root()->set_red(false);
+  }
+
+  // x replaced a removed black node under x_parent; x itself may be null
+  void red_black_erase_fixup(sentinel_node* x, sentinel_node* x_parent) noexcept {
+    while (x != take_root() && !is_red(x)) {
+      if (x == x_parent->left) {
+        sentinel_node* w = x_parent->right;
+        if (w->red()) {
+          w->set_red(false);
+          x_parent->set_red(true);
+          rotate_left(x_parent);
+          w = x_parent->right;
+        }
+        if (!is_red(w->left) && !is_red(w->right)) {
+          w->set_red(true);
+          x = x_parent;
+          x_parent = x_parent->parent();
+        } else {
+          if (!is_red(w->right)) {
+            w->left->set_red(false);
+            w->set_red(true);
+            rotate_right(w);
+            w = x_parent->right;
+          }
+          w->set_red(x_parent->red());
+          x_parent->set_red(false);
+          w->right->set_red(false);
+          rotate_left(x_parent);
+          x = take_root();
+        }
+      } else {
+        sentinel_node* w = x_parent->left;
+        if (w->red()) {
+          w->set_red(false);
+          x_parent->set_red(true);
+          rotate_right(x_parent);
+          w = x_parent->left;
+        }
+        if (!is_red(w->right) && !is_red(w->left)) {
+          w->set_red(true);
+          x = x_parent;
+          x_parent = x_parent->parent();
+        } else {
+          if (!is_red(w->left)) {
+            w->right->set_red(false);
+            w->set_red(true);
+            rotate_left(w);
+            w = x_parent->left;
+          }
+          w->set_red(x_parent->red());
+          x_parent->set_red(false);
+          w->left->set_red(false);
+          rotate_right(x_parent);
+          x = take_root();
+        }
+      }
+    }
+    if (x) {
+      x->set_red(false);
+    }
+  }
+
+  void rebalance_after_insert(sentinel_node* new_node) noexcept {
+    if constexpr (is_red_black) {
+      red_black_insert_fixup(new_node);
+    } else if constexpr (is_avl) {
+      avl_retrace(new_node->parent());
+    }
+  }
+
+  template <typename... Args>
+  struct is_value : std::false_type {};
+
+  template <typename Arg>
+  struct is_value<Arg> : std::is_same<std::remove_cv_t<std::remove_reference_t<Arg>>, T> {};
+
+  // Either the node equal to the key, or the place where a new node would be linked
+  struct insert_point {
+    sentinel_node* parent{nullptr};
+    bool left{true};
+    sentinel_node* existing{nullptr};
+  };
+
+  insert_point find_insert_point(const T& val) const {
+    if (empty()) {
+      return {end_node(), true, nullptr};
+    }
+    // One comparison per level. The last node we turned right at is the greatest one not
+    // greater than val, so val is a duplicate exactly when it is not less than val.
+    insert_point pos;
+    sentinel_node* not_greater = nullptr;
+    sentinel_node* current = take_root();
+    std::uint64_t steps = 0;
+    while (current != nullptr) {
+      ++steps;
+      pos.parent = current;
+      pos.left = less(val, value(current));
+      if (pos.left) {
+        current = current->left;
+      } else {
+        not_greater = current;
+        current = current->right;
+      }
+    }
+    count_search(steps);
+    if (not_greater && !less(value(not_greater), val)) {
+      return {nullptr, true, not_greater};
+    }
+    return pos;
+  }
+
+  // Checks the neighbours of hint first, so a correct hint costs O(1) comparisons
+  insert_point find_insert_point(sentinel_node* hint, const T& val) const {
+    if (empty()) {
+      return find_insert_point(val);
+    }
+    if (hint == &fake_) {
+      if (less(value(rightmost_), val)) {
+        return {rightmost_, false, nullptr};
+      }
+      return find_insert_point(val);
+    }
+    if (less(val, value(hint))) {
+      if (hint == leftmost_) {
+        return {hint, true, nullptr};
+      }
+      sentinel_node* before = s_iterator::find_prev(hint);
+      if (less(value(before), val)) {
+        return before->right ? insert_point{hint, true, nullptr} : insert_point{before, false, nullptr};
+      }
+      return find_insert_point(val);
+    }
+    if (less(value(hint), val)) {
+      if (hint == rightmost_) {
+        return {hint, false, nullptr};
+      }
+      sentinel_node* after = s_iterator::find_next(hint);
+      if (less(val, value(after))) {
+        return hint->right ? insert_point{after, true, nullptr} : insert_point{hint, false, nullptr};
+      }
+      return find_insert_point(val);
+    }
+    return {nullptr, true, hint};
+  }
+
+  // In-order links are kept apart from the tree: rotations and relinking of subtrees do not
+  // change the order, only adding and removing elements and cutting the sequence do
+  static void link_in_order(sentinel_node* n, sentinel_node* prev, sentinel_node* next) noexcept {
+    if constexpr (is_linked) {
+      n->prev_in_order = prev;
+      n->next_in_order = next;
+      if (prev) {
+        prev->next_in_order = n;
+      }
+      next->prev_in_order = n;
+    }
+  }
+
+  static void unlink_in_order(sentinel_node* n) noexcept {
+    if constexpr (is_linked) {
+      if (n->prev_in_order) {
+        n->prev_in_order->next_in_order = n->next_in_order;
+      }
+      n->next_in_order->prev_in_order = n->prev_in_order;
+      n->prev_in_order = nullptr;
+      n->next_in_order = nullptr;
+    }
+  }
+
+  // Ends the in-order sequence at leftmost_ and rightmost_, the links in between must be correct
+  void close_in_order() noexcept {
+    if constexpr (is_linked) {
+      fake_.prev_in_order = rightmost_;
+      if (rightmost_) {
+        leftmost_->prev_in_order = nullptr;
+        rightmost_->next_in_order = &fake_;
+      }
+    }
+  }
+
+  // O(n) Links all nodes in order walking the tree by parent pointers
+  void link_all_in_order() noexcept {
+    if constexpr (is_linked) {
+      sentinel_node* prev = nullptr;
+      for (sentinel_node* current = leftmost_; current; current = s_iterator::walk_next(current)) {
+        current->prev_in_order = prev;
+        if (prev) {
+          prev->next_in_order = current;
+        }
+        prev = current;
+        if (current == rightmost_) {
+          break;
+        }
+      }
+      close_in_order();
+    }
+  }
+
+  // A new leaf comes right before its parent if it is the left child and right after it otherwise
+  void link_node(const insert_point& pos, sentinel_node* new_node) noexcept {
+    modify_assert();
+    if constexpr (is_counted) {
+      std::size_t depth = 1;
+      for (sentinel_node* n = pos.parent; n != &fake_; n = n->parent()) {
+        ++depth;
+      }
+      tally_depth(depth);
+    }
+    if constexpr (is_linked) {
+      if (pos.parent == &fake_) {
+        link_in_order(new_node, nullptr, &fake_);
+      } else if (pos.left) {
+        link_in_order(new_node, pos.parent->prev_in_order, pos.parent);
+      } else {
+        link_in_order(new_node, pos.parent, pos.parent->next_in_order);
+      }
+    }
+    if (pos.parent == &fake_) {
+      put_root(new_node);
+      leftmost_ = new_node;
+      rightmost_ = new_node;
+    } else if (pos.left) {
+      pos.parent->left = new_node;
+      if (pos.parent == leftmost_) {
+        leftmost_ = new_node;
+      }
+    } else {
+      pos.parent->right = new_node;
+      if (pos.parent == rightmost_) {
+        rightmost_ = new_node;
+      }
+    }
+    ++size_;
+    if constexpr (has_order_statistics) {
+      adjust_sizes(new_node->parent(), 1);
+    }
+    rebalance_after_insert(new_node);
+    after_change();
+  }
+
+  template <typename V>
+  std::pair<sentinel_node*, bool> insert_unique(V&& val) {
+    return link_new_node(find_insert_point(val), std::forward<V>(val));
+  }
+
+  template <typename V>
+  std::pair<sentinel_node*, bool> insert_unique(sentinel_node* hint, V&& val) {
+    return link_new_node(find_insert_point(hint, val), std::forward<V>(val));
+  }
+
+  template <typename V>
+  std::pair<sentinel_node*, bool> link_new_node(const insert_point& pos, V&& val) {
+    if (pos.existing) {
+      return {pos.existing, false};
+    }
+    node* new_node = create_node(pos.parent, std::forward<V>(val));
+    link_node(pos, new_node);
+    return {new_node, true};
+  }
+
+  // Links a node that already holds its value, destroys it if the value is a duplicate
+  std::pair<sentinel_node*, bool> link_constructed_node(sentinel_node* hint, node* new_node) {
+    insert_point pos;
+    try {
+      pos = hint ? find_insert_point(hint, new_node->value_) : find_insert_point(new_node->value_);
+    } catch (...) {
+      destroy_node(new_node);
+      throw;
+    }
+    if (pos.existing) {
+      destroy_node(new_node);
+      return {pos.existing, false};
+    }
+    new_node->set_parent(pos.parent);
+    link_node(pos, new_node);
+    return {new_node, true};
+  }
+
+  // Builds a perfectly balanced tree from count nodes chained through right in sorted order
+  static sentinel_node* build_balanced(sentinel_node*& list, std::size_t count, int depth, int red_depth) noexcept {
+    if (count == 0) {
+      return nullptr;
+    }
+    std::size_t left_count = (count - 1) / 2;
+    sentinel_node* left = build_balanced(list, left_count, depth + 1, red_depth);
+    sentinel_node* root = list;
+    list = list->right;
+    root->left = left;
+    if (left) {
+      left->set_parent(root);
+    }
+    root->right = build_balanced(list, count - 1 - left_count, depth + 1, red_depth);
+    if (root->right) {
+      root->right->set_parent(root);
+    }
+    if constexpr (is_red_black) {
+      // Every level but the last is full, so coloring just the last one red keeps black heights equal
+      root->set_red(depth == red_depth);
+    } else if constexpr (is_avl) {
+      update_height(root);
+    }
+    if constexpr (has_order_statistics) {
+      update_size(root);
+    }
+    return root;
+  }
+
+  void link_sorted_list(sentinel_node* head, sentinel_node* tail, std::size_t count) noexcept {
+    modify_assert();
+    int last_level = 0;
+    while ((std::size_t(2) << last_level) <= count) {
+      ++last_level;
+    }
+    if constexpr (is_linked) {
+      sentinel_node* prev = nullptr;
+      for (sentinel_node* current = head; current != tail; current = current->right) {
+        current->prev_in_order = prev;
+        current->next_in_order = current->right;
+        prev = current;
+      }
+      tail->prev_in_order = prev;
+    }
+    sentinel_node* list = head;
+    sentinel_node* root = build_balanced(list, count, 0, last_level > 0 ? last_level : -1);
+    put_root(root);
+    root->set_parent(&fake_);
+    leftmost_ = head;
+    rightmost_ = tail;
+    size_ = count;
+    close_in_order();
+  }
+
+  static constexpr const char* text_magic = "debugset";
+  // Version 1 wrote the text elements bare, which split strings at whitespace
+  static constexpr std::uint64_t text_version = 2;
+
+  // The text of a field is written and parsed through these two buffers instead of string
+  // streams, which would pull <sstream> into every user of set.
+  // Collects what operator<< writes
+  struct field_sink : std::streambuf {
+    std::string text;
+
+    int_type overflow(int_type c) override {
+      if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        text.push_back(traits_type::to_char_type(c));
+      }
+      return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+      text.append(s, static_cast<std::size_t>(n));
+      return n;
+    }
+  };
+
+  // Hands the text of one field to operator>>
+  struct field_source : std::streambuf {
+    explicit field_source(std::string& field) {
+      setg(field.data(), field.data(), field.data() + field.size());
+    }
+  };
+
+  // A text element is the length of its text, a space, the text and a newline, so any
+  // bytes, including spaces, newlines or nothing at all, read back as they were written
+  static void write_field(std::ostream& out, const T& value) {
+    if constexpr (is_char_string<T>::value) {
+      out << value.size() << ' ';
+      out.write(value.data(), static_cast<std::streamsize>(value.size()));
+    } else {
+      field_sink sink;
+      std::ostream text(&sink);
+      text << value;
+      out << sink.text.size() << ' ' << sink.text;
+    }
+    out << '\n';
+  }
+
+  // Reads the text in chunks, so a garbage length fails at the end of the input instead of
+  // allocating it up front
+  static bool read_field(std::istream& in, std::string& field) {
+    std::uint64_t length = 0;
+    if (!(in >> length) || in.get() != ' ') {
+      in.setstate(std::ios::failbit);
+      return false;
+    }
+    constexpr std::uint64_t chunk = 4096;
+    field.clear();
+    while (length != 0) {
+      const std::size_t part = static_cast<std::size_t>(std::min(length, chunk));
+      const std::size_t old_size = field.size();
+      field.resize(old_size + part);
+      if (!in.read(field.data() + old_size, static_cast<std::streamsize>(part))) {
+        return false;
+      }
+      length -= part;
+    }
+    if (in.get() != '\n') {
+      in.setstate(std::ios::failbit);
+      return false;
+    }
+    return true;
+  }
+
+  // Reads the elements of a serialized set for build_sorted. It ends early, with failbit set on
+  // the stream, when an element cannot be read or does not follow the previous one.
+  class element_reader {
+    std::istream* in_{nullptr};
+    std::uint64_t left_{0};
+    const set* owner_{nullptr};
+    // The current element and the previous one, to check the order without copying. They are
+    // constructed from what was read, so T needs no default constructor
+    std::optional<T> values_[2];
+    bool current_{false};
+
+    void read() {
+      std::optional<T>& next = values_[!current_];
+      if constexpr (std::is_trivially_copyable_v<T>) {
+        alignas(T) unsigned char bytes[sizeof(T)];
+        if (in_->read(reinterpret_cast<char*>(bytes), sizeof(T))) {
+          next.emplace(*std::launder(reinterpret_cast<const T*>(bytes)));
+        }
+      } else {
+        std::string field;
+        if (read_field(*in_, field)) {
+          if constexpr (is_char_string<T>::value) {
+            next.emplace(field.begin(), field.end());
+          } else {
+            // operator>> needs an object to read into, the only default construction here
+            field_source source(field);
+            std::istream text(&source);
+            T parsed{};
+            if (text >> parsed && (text >> std::ws).eof()) {
+              next.emplace(std::move(parsed));
+            } else {
+              in_->setstate(std::ios::failbit);
+            }
+          }
+        }
+      }
+      if (!*in_) {
+        left_ = 0;
+        return;
+      }
+      current_ = !current_;
+    }
+
+  public:
+    element_reader() = default;
+
+    element_reader(std::istream& in, std::uint64_t count, const set& owner) : in_(&in), left_(count), owner_(&owner) {
+      if (left_ != 0) {
+        read();
+      }
+    }
+
+    const T& operator*() const noexcept {
+      return *values_[current_];
+    }
+
+    element_reader& operator++() {
+      if (--left_ != 0) {
+        read();
+        if (left_ != 0 && !owner_->less(*values_[!current_], *values_[current_])) {
+          in_->setstate(std::ios::failbit);
+          left_ = 0;
+        }
+      }
+      return *this;
+    }
+
+    friend bool operator!=(const element_reader& left, const element_reader& right) noexcept {
+      return left.left_ != right.left_;
+    }
+  };
+
+  // Expects an empty set and sorted unique input
+  template <typename InputIt>
+  void build_sorted(InputIt first, InputIt last) {
+    change_guard guard{*this};
+    sentinel_node* head = nullptr;
+    sentinel_node* tail = nullptr;
+    std::size_t count = 0;
+    try {
+      for (; first != last; ++first) {
+        node* new_node = create_node(nullptr, *first);
+        assert(!tail || less(value(tail), new_node->value_));
+        if (tail) {
+          tail->right = new_node;
+        } else {
+          head = new_node;
+        }
+        tail = new_node;
+        ++count;
+      }
+    } catch (...) {
+      while (head) {
+        sentinel_node* next = head->right;
+        destroy_node(head);
+        head = next;
+      }
+      throw;
+    }
+    if (count != 0) {
+      link_sorted_list(head, tail, count);
+    }
+  }
+
+  // Unlinks z from the tree and restores the balance, z itself is not destroyed
+  void unlink(sentinel_node* z) noexcept {
+    modify_assert();
+    unlink_in_order(z);
+    if (z == leftmost_) {
+      leftmost_ = z->right ? s_iterator::find_min(z->right) : z->parent();
+    }
+    if (z == rightmost_) {
+      rightmost_ = z->left ? s_iterator::find_max(z->left) : z->parent();
+    }
+    if (leftmost_ == &fake_) {
+      leftmost_ = nullptr;
+    }
+    if (rightmost_ == &fake_) {
+      rightmost_ = nullptr;
+    }
+    if (z->left && z->right) {
+      swap_with_successor(z, s_iterator::find_min(z->right));
+    }
+    sentinel_node* child = z->left ? z->left : z->right;
+    sentinel_node* parent = z->parent();
+    replace_child(parent, z, child);
+    if (child) {
+      child->set_parent(parent);
+    }
+    if constexpr (has_order_statistics) {
+      adjust_sizes(parent, std::size_t(-1));
+    }
+    if constexpr (is_red_black) {
+      if (!z->red()) {
+        red_black_erase_fixup(child, parent);
+      }
+    } else if constexpr (is_avl) {
+      avl_retrace(parent);
+    }
+  }
+
+  // Makes a node taken out of a tree look freshly created
+  static void reset_links(sentinel_node* n) noexcept {
+    n->left = nullptr;
+    n->right = nullptr;
+    n->set_parent(nullptr);
+    n->set_red(false);
+    static_cast<node_data&>(*static_cast<node*>(n)) = node_data();
+    static_cast<statistics_data&>(*static_cast<node*>(n)) = statistics_data();
+  }
+
+  void forget_nodes() noexcept {
+    modify_assert();
+    put_root(nullptr);
+    leftmost_ = nullptr;
+    rightmost_ = nullptr;
+    size_ = 0;
+    close_in_order();
+  }
+
+  // Makes a detached tree the whole content of the set, size_ is left to the caller.
+  // The in-order links inside it are kept, only their ends are redirected to this set.
+  void install_tree(sentinel_node* root) noexcept {
+    modify_assert();
+    put_root(root);
+    if (!root) {
+      leftmost_ = nullptr;
+      rightmost_ = nullptr;
+    } else {
+      root->set_parent(&fake_);
+      if constexpr (is_red_black) {
+        root->set_red(false);
+      }
+      leftmost_ = s_iterator::find_min(root);
+      rightmost_ = s_iterator::find_max(root);
+    }
+    close_in_order();
+  }
+
+  // Returns the node after n
+  sentinel_node* erase_node(sentinel_node* n) noexcept {
+    sentinel_node* next = s_iterator::find_next(n);
+    unlink(n);
+    destroy_node(n);
+    --size_;
+    after_change();
+    return next;
+  }
+
+  // Points the iterators of a node taken from another set at this one
+  void adopt_iterators(sentinel_node* n) noexcept {
+    if constexpr (is_tracked) {
+      for (tracked_position* it = n->share; it; it = it->next_) {
+        it->uncount();
+        it->container_ = this;
+        it->count();
+      }
+    }
+  }
+
+  // Adopts the iterators of the nodes from first to the greatest one, returns their number
+  std::size_t adopt_nodes(sentinel_node* first) noexcept {
+    std::size_t count = 0;
+    for (sentinel_node* current = first;; current = s_iterator::find_next(current)) {
+      adopt_iterators(current);
+      ++count;
+      if (current == rightmost_) {
+        return count;
+      }
+    }
+  }
+
+  void adopt_all() noexcept {
+    if (!empty()) {
+      adopt_nodes(leftmost_);
+    }
+  }
+
+  // Nodes can only move between sets whose allocators free each other's memory.
+  // An empty set takes over the allocator of the other one.
+  bool can_take_nodes_from(const set& other) noexcept {
+    if (empty() && !(alloc_ == other.alloc_)) {
+      alloc_ = other.alloc_;
+    }
+    return alloc_ == other.alloc_;
+  }
+
+  // Moves the element of n into a node of destination, a free slot of it or the heap, or into
+  // a heap node of this set if destination is nullptr. The new node takes the place of n in this
+  // tree. Tracked iterators follow the element, generation checked ones are invalidated as by
+  // erase. Strong, nothrow into a slot if T is nothrow move constructible.
+  sentinel_node* relocate(sentinel_node* n, set* destination) {
+    modify_assert();
+    sentinel_node* parent = n->parent();
+    T& val = static_cast<node*>(n)->value_;
+    node* moved = destination ? destination->create_node(parent, std::move_if_noexcept(val))
+                              : create_heap_node(parent, std::move_if_noexcept(val));
+    copy_node_data(moved, n);
+    moved->left = n->left;
+    moved->right = n->right;
+    if (moved->left) {
+      moved->left->set_parent(moved);
+    }
+    if (moved->right) {
+      moved->right->set_parent(moved);
+    }
+    replace_child(parent, n, moved);
+    if constexpr (is_linked) {
+      moved->prev_in_order = n->prev_in_order;
+      moved->next_in_order = n->next_in_order;
+      if (moved->prev_in_order) {
+        moved->prev_in_order->next_in_order = moved;
+      }
+      moved->next_in_order->prev_in_order = moved;
+    }
+    if (leftmost_ == n) {
+      leftmost_ = moved;
+    }
+    if (rightmost_ == n) {
+      rightmost_ = moved;
+    }
+    if constexpr (is_tracked) {
+      moved->share = std::exchange(n->share, nullptr);
+      for (tracked_position* it = moved->share; it; it = it->next_) {
+        it->node_ = moved;
+      }
+    }
+    destroy_node(n);
+    return moved;
+  }
+
+  // Before nodes go over to destination, moves those of them in the slots picked by mask out of
+  // the slots of this set: into the free slots of destination, or to the heap for the ones that
+  // do not fit, for every node if destination is nullptr. Strong. The heap moves come first and
+  // the rest cannot throw, so no node of this tree is left in a slot of destination by an exception.
+  void move_inline_nodes(set* destination, std::uint64_t mask = ~std::uint64_t(0)) {
+    if constexpr (inline_capacity > 0) {
+      mask &= fake_.used;
+      if (mask == 0) {
+        return;
+      }
+      std::size_t room = destination && std::is_nothrow_move_constructible_v<T> ? destination->fake_.free_slots() : 0;
+      for (std::size_t i = 0; i < inline_capacity; ++i) {
+        if (mask >> i & 1) {
+          if (room > 0) {
+            --room;
+          } else {
+            relocate(fake_.slot(i), nullptr);
+            mask &= ~(std::uint64_t(1) << i);
+          }
+        }
+      }
+      for (std::size_t i = 0; i < inline_capacity; ++i) {
+        if (mask >> i & 1) {
+          relocate(fake_.slot(i), destination);
+        }
+      }
+    }
+  }
+
+  // Fallback for sets with unequal allocators: copies the elements missing here
+  // and erases them from source, their iterators are invalidated
+  void copy_missing_from(set& source) {
+    for (sentinel_node* current = source.leftmost_; current;) {
+      sentinel_node* next = current == source.rightmost_ ? nullptr : s_iterator::find_next(current);
+      if (insert_unique(value(current)).second) {
+        source.erase_node(current);
+      }
+      current = next;
+    }
+  }
+
+  // Self checks behind validate(), each is false at the first broken invariant
+
+  static std::uint64_t mix(std::uint64_t x) noexcept {
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+  }
+
+  // Black nodes from n up to the root, the same for every node with a missing child
+  int blacks_above(const sentinel_node* n) const noexcept {
+    int result = 0;
+    for (; n != &fake_; n = n->parent()) {
+      result += !n->red();
+    }
+    return result;
+  }
+
+  // n against its children: links, balance data, subtree size, in-order links and stamp
+  bool check_node(const sentinel_node* n, int blacks) const noexcept {
+    if ((n->left && n->left->parent() != n) || (n->right && n->right->parent() != n)) {
+      return false;
+    }
+    if constexpr (is_red_black) {
+      if (n->red() && (is_red(n->left) || is_red(n->right))) {
+        return false;
+      }
+      if ((!n->left || !n->right) && blacks_above(n) != blacks) {
+        return false;
+      }
+    } else if constexpr (is_avl) {
+      int l = height(n->left);
+      int r = height(n->right);
+      if (l - r > 1 || r - l > 1 || height(n) != std::max(l, r) + 1) {
+        return false;
+      }
+    }
+    if constexpr (has_order_statistics) {
+      if (subtree_size(n) != subtree_size(n->left) + subtree_size(n->right) + 1) {
+        return false;
+      }
+    }
+    if constexpr (is_linked) {
+      if (!n->next_in_order || n->next_in_order->prev_in_order != n) {
+        return false;
+      }
+    }
+    if constexpr (is_generation_checked) {
+      if (n->stamp == 0 || (n->stamp & 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Every tracked iterator in the list of n points at n and at this set
+  bool check_iterators(const sentinel_node* n) const noexcept {
+    if constexpr (is_tracked) {
+      const tracked_position* prev = nullptr;
+      for (const tracked_position* it = n->share; it; prev = it, it = it->next_) {
+        if (it->node_ != n || it->container_ != this || it->prev_ != prev) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // fake_, the size and the cached ends, O(h)
+  bool check_ends() const noexcept {
+    sentinel_node* root = take_root();
+    if (!root) {
+      return size_ == 0 && !leftmost_ && !rightmost_;
+    }
+    if (size_ == 0 || root->parent() != &fake_ || leftmost_ != s_iterator::find_min(root) ||
+        rightmost_ != s_iterator::find_max(root)) {
+      return false;
+    }
+    if constexpr (is_red_black) {
+      if (root->red()) {
+        return false;
+      }
+    }
+    if constexpr (has_order_statistics) {
+      if (subtree_size(root) != size_) {
+        return false;
+      }
+    }
+    if constexpr (is_linked) {
+      if (leftmost_->prev_in_order || fake_.prev_in_order != rightmost_) {
+        return false;
+      }
+    }
+    if constexpr (is_generation_checked) {
+      if (!(fake_.stamp & 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Walks down from the root taking the child the bits of seed choose, each node on the way
+  // must lie between the ancestors it is left and right of
+  bool check_path(std::uint64_t seed) const {
+    if (!check_ends() || !check_iterators(&fake_)) {
+      return false;
+    }
+    sentinel_node* n = take_root();
+    int blacks = black_height(n);
+    sentinel_node* low = nullptr;
+    sentinel_node* high = nullptr;
+    while (n) {
+      if (!check_node(n, blacks) || !check_iterators(n) || (low && !less(value(low), value(n))) ||
+          (high && !less(value(n), value(high)))) {
+        return false;
+      }
+      bool left = seed & 1;
+      seed = seed >> 1 | seed << 63;
+      sentinel_node* next = left ? n->left : n->right;
+      if (!next) {
+        next = left ? n->right : n->left;
+      }
+      if (next && next == n->left) {
+        high = n;
+      } else {
+        low = n;
+      }
+      n = next;
+    }
+    return true;
+  }
+
+  // Walks all nodes in order by parent pointers, O(n log n) with the balance checks
+  bool check_structure(bool iterators) const {
+    if (!check_ends() || (iterators && !check_iterators(&fake_))) {
+      return false;
+    }
+    int blacks = black_height(take_root());
+    std::size_t count = 0;
+    // Every taken inline slot holds a node of this tree
+    std::size_t inline_count = 0;
+    // And the count of iterators at elements is right
+    std::size_t element_iterators = 0;
+    sentinel_node* prev = nullptr;
+    for (sentinel_node* n = leftmost_; n && n != &fake_; n = s_iterator::walk_next(n)) {
+      // A broken tree may have a cycle
+      if (++count > size_) {
+        return false;
+      }
+      inline_count += fake_.owns(n);
+      if constexpr (is_tracked) {
+        for (const tracked_position* it = iterators ? n->share : nullptr; it; it = it->next_) {
+          ++element_iterators;
+        }
+      }
+      if (!check_node(n, blacks) || (prev && !less(value(prev), value(n))) ||
+          (iterators && !check_iterators(n))) {
+        return false;
+      }
+      if constexpr (is_linked) {
+        if (n->prev_in_order != prev) {
+          return false;
+        }
+      }
+      prev = n;
+    }
+    if constexpr (inline_capacity > 0) {
+      if (inline_count != inline_capacity - fake_.free_slots()) {
+        return false;
+      }
+    }
+    if (iterators && element_iterators != element_iterators_) {
+      return false;
+    }
+    return count == size_;
+  }
+
+  // Called when a modification is over, runs the sampled validation if the policy asks for it
+  void after_change() noexcept {
+    if constexpr (sample_period != 0) {
+      ++this->changes_;
+      assert(this->changes_ % sample_period != 0 ? check_path(mix(this->changes_)) : check_structure(true));
+    }
+  }
+
+  // Ends a bulk operation with after_change, whichever way it returns
+  struct change_guard {
+    set& owner;
+
+    ~change_guard() {
+      owner.after_change();
+    }
+  };
+
+  static int black_height(const sentinel_node* n) noexcept {
+    int result = 0;
+    for (; n; n = n->left) {
+      result += !n->red();
+    }
+    return result;
+  }
+
+  // Links the detached trees left < pivot < right into one balanced tree under fake_,
+  // leftmost_ and rightmost_ are left to the caller.
+  // The pivot is hung on the spine of the taller tree at the height of the shorter one
+  // and rebalanced like an inserted node, so this costs O(h).
+  void join_trees(sentinel_node* left, sentinel_node* pivot, sentinel_node* right) noexcept {
+    modify_assert();
+    reset_links(pivot);
+    bool left_taller = false;
+    bool right_taller = false;
+    int left_height = 0;
+    int right_height = 0;
+    if constexpr (is_red_black) {
+      if (left) {
+        left->set_red(false);
+      }
+      if (right) {
+        right->set_red(false);
+      }
+      left_height = black_height(left);
+      right_height = black_height(right);
+      left_taller = left_height > right_height;
+      right_taller = right_height > left_height;
+    } else if constexpr (is_avl) {
+      left_height = height(left);
+      right_height = height(right);
+      left_taller = left_height > right_height + 1;
+      right_taller = right_height > left_height + 1;
+    }
+
+    if (left_taller) {
+      put_root(left);
+      left->set_parent(&fake_);
+      sentinel_node* parent = nullptr;
+      sentinel_node* current = left;
+      // Descend to the subtree the right tree can stand next to
+      if constexpr (is_red_black) {
+        for (int h = left_height; current && (current->red() || h > right_height); current = current->right) {
+          h -= !current->red();
+          parent = current;
+        }
+      } else if constexpr (is_avl) {
+        for (; height(current) > right_height + 1; current = current->right) {
+          parent = current;
+        }
+      }
+      pivot->left = current;
+      pivot->right = right;
+      parent->right = pivot;
+      pivot->set_parent(parent);
+    } else if (right_taller) {
+      put_root(right);
+      right->set_parent(&fake_);
+      sentinel_node* parent = nullptr;
+      sentinel_node* current = right;
+      if constexpr (is_red_black) {
+        for (int h = right_height; current && (current->red() || h > left_height); current = current->left) {
+          h -= !current->red();
+          parent = current;
+        }
+      } else if constexpr (is_avl) {
+        for (; height(current) > left_height + 1; current = current->left) {
+          parent = current;
+        }
+      }
+      pivot->left = left;
+      pivot->right = current;
+      parent->left = pivot;
+      pivot->set_parent(parent);
+    } else {
+      pivot->left = left;
+      pivot->right = right;
+      put_root(pivot);
+      pivot->set_parent(&fake_);
+    }
+    if (pivot->left) {
+      pivot->left->set_parent(pivot);
+    }
+    if (pivot->right) {
+      pivot->right->set_parent(pivot);
+    }
+
+    if constexpr (is_avl) {
+      update_height(pivot);
+    }
+    if constexpr (has_order_statistics) {
+      for (sentinel_node* n = pivot; n != &fake_; n = n->parent()) {
+        update_size(n);
+      }
+    }
+    if (left_taller || right_taller) {
+      rebalance_after_insert(pivot);
+    }
+  }
+
+  // join_trees for trees that stay detached, returns the new root
+  sentinel_node* join_detached(sentinel_node* left, sentinel_node* pivot, sentinel_node* right) noexcept {
+    join_trees(left, pivot, right);
+    sentinel_node* root = take_root();
+    root->set_parent(nullptr);
+    put_root(nullptr);
+    return root;
+  }
+
+  // Chains all nodes through left in descending order and returns the greatest one.
+  // Only already visited nodes are changed, so the walk itself is not disturbed.
+  // The tree is unusable afterwards, the set must be rebuilt or forgotten.
+  sentinel_node* flatten_backward() noexcept {
+    modify_assert();
+    sentinel_node* previous = nullptr;
+    for (sentinel_node* current = leftmost_; current;) {
+      sentinel_node* next = current == rightmost_ ? nullptr : s_iterator::find_next(current);
+      current->left = previous;
+      previous = current;
+      current = next;
+    }
+    return previous;
+  }
+
+  // A sorted list being built from the greatest element down
+  struct sorted_list {
+    sentinel_node* head{nullptr};
+    sentinel_node* tail{nullptr};
+    std::size_t count{0};
+
+    void push_front(sentinel_node* n) noexcept {
+      n->right = head;
+      head = n;
+      if (!tail) {
+        tail = n;
+      }
+      ++count;
+    }
+  };
+
+  // Rebuilds the set from a descending chain through left followed by list
+  void relink_sorted(sentinel_node* rest, sorted_list list) noexcept {
+    while (rest) {
+      sentinel_node* next = rest->left;
+      list.push_front(rest);
+      rest = next;
+    }
+    forget_nodes();
+    if (list.count != 0) {
+      link_sorted_list(list.head, list.tail, list.count);
+    }
+  }
+
+  // Whether m separate tree operations on n elements are cheaper than one O(n + m) pass
+  static bool cheaper_one_by_one(std::size_t m, std::size_t n) noexcept {
+    std::size_t log_n = 1;
+    while (log_n < 8 * sizeof(std::size_t) && (std::size_t(1) << log_n) < n) {
+      ++log_n;
+    }
+    return m * log_n < n + m;
+  }
+
+  void merge_one_by_one(set& source) {
+    for (sentinel_node* current = source.leftmost_; current;) {
+      sentinel_node* next = current == source.rightmost_ ? nullptr : s_iterator::find_next(current);
+      insert_point pos = find_insert_point(value(current));
+      if (!pos.existing) {
+        source.unlink(current);
+        --source.size_;
+        reset_links(current);
+        adopt_iterators(current);
+        current->set_parent(pos.parent);
+        link_node(pos, current);
+      }
+      current = next;
+    }
+  }
+
+  // Merges the two flattened trees from the greatest elements down. If Compare throws,
+  // everything merged so far stays here and the rest goes back to its set.
+  void merge_linear(set& source) {
+    sentinel_node* mine = flatten_backward();
+    sentinel_node* theirs = source.flatten_backward();
+    sorted_list merged;
+    sorted_list duplicates;
+    try {
+      while (mine || theirs) {
+        if (!mine || (theirs && less(value(mine), value(theirs)))) {
+          sentinel_node* next = theirs->left;
+          adopt_iterators(theirs);
+          merged.push_front(theirs);
+          theirs = next;
+        } else if (!theirs || less(value(theirs), value(mine))) {
+          sentinel_node* next = mine->left;
+          merged.push_front(mine);
+          mine = next;
+        } else {
+          sentinel_node* next_mine = mine->left;
+          sentinel_node* next_theirs = theirs->left;
+          merged.push_front(mine);
+          duplicates.push_front(theirs);
+          mine = next_mine;
+          theirs = next_theirs;
+        }
+      }
+    } catch (...) {
+      relink_sorted(mine, merged);
+      source.relink_sorted(theirs, duplicates);
+      throw;
+    }
+    relink_sorted(nullptr, merged);
+    source.relink_sorted(nullptr, duplicates);
+  }
+
+  // Destroys the elements for which drop returns true in one pass over the flattened tree
+  // and rebuilds the rest balanced. drop sees the elements from the greatest down.
+  // If it throws, the elements visited so far stay dropped or kept, the others are kept.
+  template <typename Drop>
+  std::size_t drop_linear(Drop drop) {
+    change_guard guard{*this};
+    sentinel_node* current = flatten_backward();
+    sorted_list kept;
+    std::size_t dropped = 0;
+    try {
+      while (current) {
+        sentinel_node* next = current->left;
+        if (drop(value(current))) {
+          destroy_node(current);
+          ++dropped;
+        } else {
+          kept.push_front(current);
+        }
+        current = next;
+      }
+    } catch (...) {
+      relink_sorted(current, kept);
+      throw;
+    }
+    relink_sorted(nullptr, kept);
+    return dropped;
+  }
+
+  // Keeps the elements whose presence in other equals keep_common, destroys the rest
+  void filter_linear(const set& other, bool keep_common) {
+    filter_linear(other.rightmost_, keep_common);
+  }
+
+  // The same, walking the other set down from theirs. Its elements after theirs must all be
+  // greater than every element here.
+  void filter_linear(sentinel_node* theirs, bool keep_common) {
+    drop_linear([&](const T& mine) {
+      while (theirs && less(mine, value(theirs))) {
+        theirs = s_iterator::find_prev(theirs);
+      }
+      bool common = theirs && !less(value(theirs), mine);
+      return common != keep_common;
+    });
   }
 
-  void del_subtree(sentinel_node* d_node) {
-    if (!d_node) {
+  friend set_parallel;
+
+  // O(n) with checked iterators, O(1) otherwise.
+  // Invalidates the iterators at the elements, tracked ones by their lists and generation
+  // checked ones by killing the stamps, while the nodes stay in the tree
+  void invalidate_element_iterators() noexcept {
+    if constexpr (is_checked) {
+      for (sentinel_node* n = leftmost_; n; n = n == rightmost_ ? nullptr : s_iterator::find_next(n)) {
+        if constexpr (is_tracked) {
+          n->invalidate_iterators();
+        } else {
+          kill_stamp(n);
+        }
+      }
+    }
+  }
+
+  // Pieces smaller than this are not worth a task of their own
+  static constexpr std::size_t parallel_grain = std::size_t(1) << 14;
+
+  static std::size_t parallel_parts(std::size_t parts, std::size_t elements) noexcept {
+    return std::min(parts, elements / parallel_grain);
+  }
+
+  // The keys of the nodes in the top levels, in order, which cut the set into at least
+  // parts pieces, into about equal ones when the tree is balanced
+  std::vector<T> cut_keys(std::size_t parts) const {
+    std::size_t depth = 0;
+    while ((std::size_t(1) << depth) < parts) {
+      ++depth;
+    }
+    std::vector<T> keys;
+    collect_top(take_root(), depth, keys);
+    return keys;
+  }
+
+  static void collect_top(const sentinel_node* n, std::size_t depth, std::vector<T>& keys) {
+    if (!n || depth == 0) {
+      return;
+    }
+    collect_top(n->left, depth - 1, keys);
+    keys.push_back(value(n));
+    collect_top(n->right, depth - 1, keys);
+  }
+
+  // Moves the elements from keys[i] up to keys[i + 1] into pieces[i],
+  // the ones less than keys[0] stay here
+  void split_pieces(const std::vector<T>& keys, std::vector<set>& pieces) {
+    pieces.reserve(keys.size());
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+      pieces.emplace_back(comp(), get_allocator());
+    }
+    for (std::size_t i = keys.size(); i-- > 0;) {
+      split(keys[i], pieces[i]);
+    }
+  }
+
+  // Takes the pieces back in order together with their counts
+  void join_pieces(std::vector<set>& pieces) {
+    for (set& piece : pieces) {
+      join(piece);
+      this->tally_all(piece);
+    }
+  }
+
+  // The greatest element less than key, nullptr if there is none
+  sentinel_node* last_below(const T& key) const {
+    sentinel_node* bound = lower_bound_node(key);
+    return bound ? s_iterator::find_prev(bound) : rightmost_;
+  }
+
+  // One task of parallel_copy: a subtree of the source to copy under parent, into slot
+  struct copy_job {
+    const sentinel_node* from;
+    sentinel_node* parent;
+    sentinel_node** slot;
+  };
+
+  // Copies the top depth levels of the tree at from, the subtrees below them are left
+  // to jobs, their slots stay null until the jobs run. jobs must have room for 2^(depth + 1)
+  // more, so that adding one cannot throw and leak the nodes copied so far.
+  sentinel_node* copy_top(const sentinel_node* from, sentinel_node* parent, std::size_t depth,
+                          std::vector<copy_job>& jobs) {
+    sentinel_node* to = create_node(parent, value(from));
+    copy_node_data(to, from);
+    for (auto side : {&sentinel_node::left, &sentinel_node::right}) {
+      const sentinel_node* child = from->*side;
+      if (!child) {
+        continue;
+      }
+      if (depth == 0) {
+        assert(jobs.size() < jobs.capacity());
+        jobs.push_back({child, to, &(to->*side)});
+      } else {
+        try {
+          to->*side = copy_top(child, to, depth - 1, jobs);
+        } catch (...) {
+          del_subtree(to);
+          throw;
+        }
+      }
+    }
+    return to;
+  }
+
+  // Splits the tree under fake_ along the path from last to the root. Walking back up, every
+  // node joins the side it belongs to together with its other subtree; the direction is known
+  // from the child, so no comparisons are needed. The subtree under last on the path side
+  // must already be in less or not_less. fake_ is left empty.
+  void split_path(sentinel_node* last, bool last_less, sentinel_node*& less, sentinel_node*& not_less) noexcept {
+    sentinel_node* child = nullptr;
+    for (sentinel_node* current = last; current != &fake_;) {
+      sentinel_node* parent = current->parent();
+      bool current_less = current == last ? last_less : child == current->right;
+      if (current_less) {
+        sentinel_node* side = current->left;
+        less = join_detached(side, current, less);
+      } else {
+        sentinel_node* side = current->right;
+        not_less = join_detached(not_less, current, side);
+      }
+      child = current;
+      current = parent;
+    }
+  }
+
+  // Splits the tree under fake_ into the nodes before n and the rest
+  void split_before(sentinel_node* n, sentinel_node*& before, sentinel_node*& rest) noexcept {
+    before = n->left;
+    if (before) {
+      before->set_parent(nullptr);
+    }
+    rest = nullptr;
+    split_path(n, false, before, rest);
+  }
+
+  // Makes the set of two detached trees, every element of left being less than every one of right.
+  // The least node of right becomes the pivot joining them.
+  void concat_trees(sentinel_node* left, sentinel_node* right) noexcept {
+    if (!left || !right) {
+      install_tree(left ? left : right);
       return;
     }
-    del_subtree(d_node->left);
-    del_subtree(d_node->right);
-    delete d_node;
+    install_tree(right);
+    sentinel_node* pivot = leftmost_;
+    sentinel_node* after_pivot = s_iterator::find_next(pivot);
+    sentinel_node* before_pivot = s_iterator::find_max(left);
+    unlink(pivot);
+    right = take_root();
+    if (right) {
+      right->set_parent(nullptr);
+    }
+    put_root(nullptr);
+    join_trees(left, pivot, right);
+    leftmost_ = s_iterator::find_min(take_root());
+    rightmost_ = s_iterator::find_max(take_root());
+    link_in_order(pivot, before_pivot, after_pivot);
+    close_in_order();
+  }
+
+  // Ranges up to this many elements are erased one by one, longer ones are cut out as a subtree
+  static constexpr std::size_t short_range = 16;
+
+  // Lookups of a batch walking the tree side by side
+  static constexpr std::size_t probe_group = 8;
+
+  // Finds the lower bounds of keys in groups of probe_group. Every step of a lookup prefetches
+  // its next node and moves on to the other lookups, so their loads overlap instead of waiting
+  // for each other. finish(i, n) gets the lower bound of keys[i], nullptr if there is none.
+  template <typename Finish>
+  void lower_bounds_grouped(const T* keys, std::size_t count, Finish finish) const {
+    for (std::size_t base = 0; base < count; base += probe_group) {
+      std::size_t lanes = std::min(probe_group, count - base);
+      sentinel_node* current[probe_group];
+      sentinel_node* bound[probe_group];
+      for (std::size_t l = 0; l < lanes; ++l) {
+        current[l] = take_root();
+        bound[l] = nullptr;
+      }
+      tally(&set_counters::searches, lanes);
+      for (bool active = true; active;) {
+        active = false;
+        for (std::size_t l = 0; l < lanes; ++l) {
+          sentinel_node* n = current[l];
+          if (!n) {
+            continue;
+          }
+          tally(&set_counters::search_steps);
+          if (less(value(n), keys[base + l])) {
+            n = n->right;
+          } else {
+            bound[l] = n;
+            n = n->left;
+          }
+          current[l] = n;
+          if (n) {
+            prefetch_address(n);
+            active = true;
+          }
+        }
+      }
+      for (std::size_t l = 0; l < lanes; ++l) {
+        finish(base + l, bound[l]);
+      }
+    }
+  }
+
+  // A node handle cannot keep an inline slot, so an inline node is moved to the heap first
+  node_type extract_node(sentinel_node* n) noexcept(inline_capacity == 0) {
+    if (fake_.owns(n)) {
+      n = relocate(n, nullptr);
+    }
+    unlink(n);
+    --size_;
+    if constexpr (is_tracked) {
+      n->invalidate_iterators();
+    }
+    restamp(n);
+    reset_links(n);
+    after_change();
+    return node_type(static_cast<node*>(n), alloc_);
+  }
+
+  // Takes the node out of nh only if it gets linked
+  std::pair<sentinel_node*, bool> insert_node(sentinel_node* hint, node_type& nh) {
+    if (nh.empty()) {
+      return {&fake_, false};
+    }
+    // As with whole sets, an empty set takes over the allocator of the node
+    if (empty() && !(alloc_ == *nh.alloc_)) {
+      alloc_ = *nh.alloc_;
+    }
+    assert(alloc_ == *nh.alloc_);
+    const T& val = nh.node_->value_;
+    insert_point pos = hint ? find_insert_point(hint, val) : find_insert_point(val);
+    if (pos.existing) {
+      return {pos.existing, false};
+    }
+    node* n = nh.release();
+    n->set_parent(pos.parent);
+    link_node(pos, n);
+    return {n, true};
+  }
+
+  // Destroys the subtree leaf by leaf, climbing back by parent pointers, with constant stack
+  template <typename Destroy>
+  static void destroy_subtree(sentinel_node* root, Destroy destroy) noexcept {
+    sentinel_node* current = root;
+    while (current) {
+      if (current->left) {
+        current = current->left;
+      } else if (current->right) {
+        current = current->right;
+      } else {
+        sentinel_node* parent = current == root ? nullptr : current->parent();
+        if (parent) {
+          (parent->left == current ? parent->left : parent->right) = nullptr;
+        }
+        destroy(current);
+        current = parent;
+      }
+    }
   }
 
-  explicit set(const std::size_t size) noexcept : fake_(sentinel_node()), size_(size) {
-    fake_.left = &fake_;
-    fake_.parent = &fake_;
+  void del_subtree(sentinel_node* d_node) noexcept {
+    destroy_subtree(d_node, [this](sentinel_node* n) { destroy_node(n); });
   }
 
+  // Destroys the nodes but leaves their memory to be freed by the allocator in bulk
+  void destroy_subtree_values(sentinel_node* d_node) noexcept {
+    destroy_subtree(d_node, [this](sentinel_node* n) {
+      destroy_value(static_cast<node*>(n));
+      if (!release_slot(n)) {
+        tally(&set_counters::node_frees);
+      }
+    });
+  }
 
+  set(const std::size_t size, const Compare& comp, const node_allocator& alloc)
+      : compare_holder<Compare>(comp), fake_(), size_(size), alloc_(alloc) {
+    if constexpr (is_generation_checked) {
+      fake_.stamp = generation_ends.fetch_add(2, std::memory_order_relaxed) | 1;
+    }
+  }
 
 public:
   // O(1) nothrow
-  set() noexcept : set(0) {}
+  set() noexcept(std::is_nothrow_default_constructible_v<Compare> &&
+                 std::is_nothrow_default_constructible_v<node_allocator>)
+      : set(0, Compare(), node_allocator()) {}
+
+  // O(1)
+  explicit set(const Compare& comp, const Allocator& alloc = Allocator()) : set(0, comp, node_allocator(alloc)) {}
+
+  // O(1)
+  explicit set(const Allocator& alloc) : set(0, Compare(), node_allocator(alloc)) {}
+
+  // O(n) strong
+  set(const set& other) : set(other, node_traits::select_on_container_copy_construction(other.alloc_)) {}
 
   // O(n) strong
-  set(const set& other) : set(other.size()) {
+  set(const set& other, const Allocator& alloc) : set(other.size(), other.comp(), node_allocator(alloc)) {
     try {
       if (!other.empty()) {
         put_root(copy_tree(other.take_root()));
-        take_root()->parent = &fake_;
+        take_root()->set_parent(&fake_);
+        leftmost_ = s_iterator::find_min(take_root());
+        rightmost_ = s_iterator::find_max(take_root());
+        link_all_in_order();
       }
     } catch (...) {
       size_ = 0;
@@ -368,29 +3039,171 @@ public:
     }
   }
 
+  // O(n log n) strong, O(n) for sorted input
+  template <typename InputIt, typename = require_input_iterator<InputIt>>
+  set(InputIt first, InputIt last, const Compare& comp = Compare(), const Allocator& alloc = Allocator())
+      : set(comp, alloc) {
+    insert(first, last);
+  }
+
+  // O(n log n) strong, O(n) for sorted input
+  template <typename InputIt, typename = require_input_iterator<InputIt>>
+  set(InputIt first, InputIt last, const Allocator& alloc) : set(first, last, Compare(), alloc) {}
+
+  // O(n) strong
+  // The input must be sorted and free of duplicates, the tree is built perfectly balanced
+  template <typename InputIt, typename = require_input_iterator<InputIt>>
+  set(sorted_unique_t, InputIt first, InputIt last, const Compare& comp = Compare(),
+      const Allocator& alloc = Allocator())
+      : set(comp, alloc) {
+    build_sorted(first, last);
+  }
+
+  // O(1) nothrow, O(n) with tracked_iterators while an iterator points at an element of other
+  // Takes the nodes over, iterators keep pointing at their elements and other is left empty.
+  // Elements in the inline nodes of other are moved into the inline nodes here.
+  set(set&& other) noexcept(std::is_nothrow_copy_constructible_v<Compare> && nothrow_inline_moves)
+      : set(0, other.comp(), other.alloc_) {
+    swap(*this, other);
+  }
+
   // O(n) strong
   set& operator=(const set& other) {
     if (this == &other) {
       return *this;
     }
-    set copy(other);
-    swap(*this, copy);
+    if constexpr (node_traits::propagate_on_container_copy_assignment::value) {
+      set copy(other, other.get_allocator());
+      swap(*this, copy);
+    } else {
+      set copy(other, get_allocator());
+      swap(*this, copy);
+    }
+    return *this;
+  }
+
+  // O(n) nothrow to clear this set, plus O(m) with tracked_iterators while an iterator points at
+  // an element of other. The nodes of other are taken over when allocators allow it, otherwise
+  // its elements are copied.
+  set& operator=(set&& other) noexcept((node_traits::propagate_on_container_move_assignment::value ||
+                                        node_traits::is_always_equal::value) &&
+                                       nothrow_inline_moves) {
+    if (this == &other) {
+      return *this;
+    }
+    // Cleared first, so the inline nodes of other find all slots here free
+    if constexpr (node_traits::propagate_on_container_move_assignment::value ||
+                  node_traits::is_always_equal::value) {
+      clear();
+      swap(*this, other);
+    } else if (alloc_ == other.alloc_) {
+      clear();
+      swap(*this, other);
+    } else {
+      set copy(other, get_allocator());
+      swap(*this, copy);
+    }
     return *this;
   }
 
   // O(n) nothrow
   ~set() noexcept {
+    modify_assert();
     clear();
+    kill_stamp(&fake_);
   }
 
   // O(n) nothrow
+  // With an allocator that supports release() the nodes are not deallocated one by one,
+  // the whole arena is dropped instead
   void clear() noexcept {
+    change_guard guard{*this};
     if (empty()) {
       return;
     }
-    del_subtree(take_root());
-    fake_.left = nullptr;
-    size_ = 0;
+    if constexpr (supports_release<node_allocator>::value) {
+      if (alloc_.unique()) {
+        destroy_subtree_values(take_root());
+        alloc_.release();
+      } else {
+        del_subtree(take_root());
+      }
+    } else {
+      del_subtree(take_root());
+    }
+    forget_nodes();
+  }
+
+  // O(n) strong
+  // Replaces the contents with sorted unique input, see set(sorted_unique_t, first, last)
+  template <typename InputIt, typename = require_input_iterator<InputIt>>
+  void assign_sorted(InputIt first, InputIt last) {
+    set sorted(get_allocator());
+    sorted.build_sorted(first, last);
+    swap(*this, sorted);
+  }
+
+  // O(n)
+  // Writes the elements in order. Trivially copyable T is written in binary form, a set_file_header
+  // followed by the raw elements, otherwise as text: a header line and one element per line, its
+  // length and its bytes, see write_field. Strings are written as they are, other T with
+  // operator<<. Errors are reported by the state of out.
+  void serialize(std::ostream& out) const {
+    if constexpr (std::is_trivially_copyable_v<T>) {
+      static_assert(alignof(T) <= sizeof(set_file_header), "elements must fit the alignment of the binary form");
+      set_file_header header = set_file_header::describe<T>(size_);
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    } else {
+      out << text_magic << ' ' << text_version << ' ' << size_ << '\n';
+    }
+    sentinel_node* n = leftmost_;
+    for (std::size_t i = 0; i < size_ && out; ++i, n = s_iterator::walk_next(n)) {
+      if constexpr (std::is_trivially_copyable_v<T>) {
+        out.write(reinterpret_cast<const char*>(&value(n)), sizeof(T));
+      } else {
+        write_field(out, value(n));
+      }
+    }
+  }
+
+  // O(n) strong
+  // Replaces the contents with a set written by serialize, building the tree from the sorted
+  // elements without searching. Text elements other than strings are parsed with operator>>,
+  // which must take the whole field. If the input is
+  // malformed, truncated or out of order, failbit is set on in and the set is left unchanged.
+  void deserialize(std::istream& in) {
+    std::uint64_t count = 0;
+    if constexpr (std::is_trivially_copyable_v<T>) {
+      set_file_header header;
+      if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return;
+      }
+      if (!header.describes<T>()) {
+        in.setstate(std::ios::failbit);
+        return;
+      }
+      count = header.count;
+    } else {
+      std::string magic;
+      std::uint64_t version = 0;
+      if (!(in >> magic >> version >> count)) {
+        return;
+      }
+      if (magic != text_magic || version != text_version) {
+        in.setstate(std::ios::failbit);
+        return;
+      }
+    }
+    set loaded(comp(), get_allocator());
+    loaded.build_sorted(element_reader(in, count, *this), element_reader());
+    if (in) {
+      swap(*this, loaded);
+    }
+  }
+
+  // O(1) nothrow
+  allocator_type get_allocator() const noexcept {
+    return allocator_type(alloc_);
   }
 
   // O(1) nothrow
@@ -408,12 +3221,12 @@ public:
     if (empty()) {
       return end();
     }
-    return s_iterator(s_iterator::find_min(take_root()), this);
+    return s_iterator(leftmost_, this);
   }
 
   // nothrow
   const_iterator end() const noexcept {
-    return const_iterator(const_cast<sentinel_node*>(&fake_), this);
+    return const_iterator(end_node(), this);
   }
 
   // nothrow
@@ -428,154 +3241,611 @@ public:
 
   // O(h) strong
   std::pair<iterator, bool> insert(const T& val) {
-    if (empty()) {
-      put_root(new node(&fake_, val));
-      ++size_;
-      fake_.parent = nullptr;
-      try {
-        return {iterator(take_root(), this), true};
-      } catch (...) {
-        clear();
-        throw;
-      }
-    }
-    sentinel_node* parent = nullptr;
-    sentinel_node* current = take_root();
+    auto [pos, inserted] = insert_unique(val);
+    return {iterator(pos, this), inserted};
+  }
 
-    while (current != nullptr) {
-      parent = current;
-      if (val < static_cast<node*>(current)->value_) {
-        current = current->left;
-      } else if (val > static_cast<node*>(current)->value_) {
-        current = current->right;
-      } else {
-        return {iterator(current, this), false};
-      }
-    }
-    node* new_node = nullptr;
-    iterator it = iterator();
-    try {
-      new_node = new node(parent, val);
-      it = iterator(new_node, this);
+  // O(h) strong
+  std::pair<iterator, bool> insert(T&& val) {
+    auto [pos, inserted] = insert_unique(std::move(val));
+    return {iterator(pos, this), inserted};
+  }
 
-    } catch (...) {
-      if (!new_node) {
-        delete new_node;
-      }
-      throw;
+  // Amortized O(1) if val belongs right before hint, O(h) otherwise, strong
+  iterator insert(const_iterator hint, const T& val) {
+    assert(hint.belongs_to(this));
+    return iterator(insert_unique(hint.node_, val).first, this);
+  }
+
+  // Amortized O(1) if val belongs right before hint, O(h) otherwise, strong
+  iterator insert(const_iterator hint, T&& val) {
+    assert(hint.belongs_to(this));
+    return iterator(insert_unique(hint.node_, std::move(val)).first, this);
+  }
+
+  // O(k log(n + k)), amortized O(k) for sorted input, basic
+  template <typename InputIt, typename = require_input_iterator<InputIt>>
+  void insert(InputIt first, InputIt last) {
+    for (; first != last; ++first) {
+      insert_unique(&fake_, *first);
     }
+  }
 
-    if (val < static_cast<node*>(parent)->value_) {
-      parent->left = new_node;
+  // O(h) strong
+  // The value is built inside a new node, as with std::set a duplicate is constructed and
+  // discarded unless the arguments are a single T
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    std::pair<sentinel_node*, bool> result;
+    if constexpr (is_value<Args...>::value) {
+      result = insert_unique(std::forward<Args>(args)...);
     } else {
-      parent->right = new_node;
+      result = link_constructed_node(nullptr, create_node(nullptr, std::forward<Args>(args)...));
     }
+    return {iterator(result.first, this), result.second};
+  }
 
-    ++size_;
-    return {it, true};
+  // Amortized O(1) if the value belongs right before hint, O(h) otherwise, strong
+  template <typename... Args>
+  iterator emplace_hint(const_iterator hint, Args&&... args) {
+    assert(hint.belongs_to(this));
+    if constexpr (is_value<Args...>::value) {
+      return iterator(insert_unique(hint.node_, std::forward<Args>(args)...).first, this);
+    } else {
+      return iterator(link_constructed_node(hint.node_, create_node(nullptr, std::forward<Args>(args)...)).first, this);
+    }
   }
 
   // O(h) nothrow
   iterator erase(const_iterator pos) {
-    assert(this == pos.container_);
+    assert(pos.belongs_to(this));
+    assert(pos.node_ != &fake_);
     if (empty()) {
       return end();
     }
-    sentinel_node* return_value = s_iterator::find_next(pos.node_);
-    sentinel_node* node_to_delete = pos.node_;
-    sentinel_node* del_parent = node_to_delete->parent;
-    sentinel_node* new_subtree = merge(node_to_delete->left, node_to_delete->right);
+    return iterator(erase_node(pos.node_), this);
+  }
 
-    if (del_parent->left == node_to_delete) {
-      del_parent->left = new_subtree;
-    } else {
-      del_parent->right = new_subtree;
-    }
+  // O(h) nothrow
+  // Unlinks the element at pos and hands its node over without deallocating it.
+  // Iterators to the element are invalidated, as with erase; references and pointers stay valid.
+  // With inline_nodes an element in an inline node is first moved to a heap node, strong,
+  // and its references and pointers are invalidated too.
+  node_type extract(const_iterator pos) noexcept(inline_capacity == 0) {
+    assert(pos.belongs_to(this));
+    assert(pos.node_ && pos.node_ != &fake_);
+    return extract_node(pos.node_);
+  }
+
+  // O(h) strong
+  // An empty handle if there is no such element
+  node_type extract(const T& val) {
+    sentinel_node* found = find_node(val);
+    return found ? extract_node(found) : node_type();
+  }
+
+  // O(h) strong
+  // Links the node of nh; if an equivalent element is already here, the node stays in the returned handle
+  insert_return_type insert(node_type&& nh) {
+    auto [pos, inserted] = insert_node(nullptr, nh);
+    return {iterator(pos, this), inserted, std::move(nh)};
+  }
 
-    if (new_subtree) {
-      new_subtree->parent = del_parent;
+  // Amortized O(1) if the element belongs right before hint, O(h) otherwise, strong
+  // nh keeps its node if an equivalent element is already here
+  iterator insert(const_iterator hint, node_type&& nh) {
+    assert(hint.belongs_to(this));
+    return iterator(insert_node(hint.node_, nh).first, this);
+  }
+
+  // O(k + h log n) nothrow for k erased elements
+  // Only iterators to the erased elements are invalidated
+  iterator erase(const_iterator first, const_iterator last) {
+    change_guard guard{*this};
+    assert(first.belongs_to(this) && last.belongs_to(this));
+    assert(first.node_ && last.node_);
+    sentinel_node* from = first.node_;
+    sentinel_node* to = last.node_;
+    if (from == to) {
+      return iterator(to, this);
+    }
+    if (from == leftmost_ && to == &fake_) {
+      clear();
+      return end();
     }
 
-    if (take_root() == node_to_delete) {
-      put_root(new_subtree ? new_subtree : del_parent);
+    sentinel_node* current = from;
+    for (std::size_t steps = 0; current != to && steps < short_range; ++steps) {
+      current = s_iterator::find_next(current);
+    }
+    if (current == to) {
+      while (from != to) {
+        from = erase_node(from);
+      }
+      return iterator(to, this);
     }
 
-    delete node_to_delete;
-    --size_;
+    // Cut [from, to) out as a tree of its own, destroy it in one pass and join what is left
+    sentinel_node* before = nullptr;
+    sentinel_node* range = nullptr;
+    sentinel_node* after = nullptr;
+    split_before(from, before, range);
+    if (to != &fake_) {
+      install_tree(range);
+      split_before(to, range, after);
+    }
+    std::size_t erased = 0;
+    destroy_subtree(range, [this, &erased](sentinel_node* n) {
+      destroy_node(n);
+      ++erased;
+    });
+    size_ -= erased;
+    concat_trees(before, after);
+    return iterator(to, this);
+  }
 
-    return iterator(return_value, this);
+  // O(n) basic
+  // Erases the elements satisfying pred in one pass and rebuilds the tree balanced
+  template <typename Pred>
+  friend std::size_t erase_if(set& s, Pred pred) {
+    return s.drop_linear(pred);
   }
 
   // O(h) strong
   const_iterator find(const T& val) const {
-    if (empty()) {
-      return end();
-    }
-    auto it = find(take_root(), val);
-    return (it ? const_iterator(it, this) : end());
+    return node_or_end(find_node(val));
+  }
+
+  // O(h) strong
+  // Looks up by any key the comparator can compare with T, without converting it to T
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator find(const K& key) const {
+    return node_or_end(find_node(key));
+  }
+
+  // O(h) strong
+  size_t count(const T& val) const {
+    return find_node(val) ? 1 : 0;
+  }
+
+  // O(h) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  size_t count(const K& key) const {
+    return find_node(key) ? 1 : 0;
+  }
+
+  // O(h) strong
+  bool contains(const T& val) const {
+    return find_node(val) != nullptr;
+  }
+
+  // O(h) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  bool contains(const K& key) const {
+    return find_node(key) != nullptr;
   }
 
   // O(h) strong
   size_t erase(const T& val) {
-    const_iterator it = find(val);
-    if (it == end()) {
+    sentinel_node* n = find_node(val);
+    if (!n) {
       return 0;
     }
-    erase(it);
+    erase_node(n);
     return 1;
   }
 
   // O(h) strong
   const_iterator lower_bound(const T& val) const {
-    if (empty()) {
+    return node_or_end(lower_bound_node(val));
+  }
+
+  // O(h) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator lower_bound(const K& key) const {
+    return node_or_end(lower_bound_node(key));
+  }
+
+  // O(h) strong
+  const_iterator upper_bound(const T& val) const {
+    return node_or_end(upper_bound_node(val));
+  }
+
+  // O(h) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  const_iterator upper_bound(const K& key) const {
+    return node_or_end(upper_bound_node(key));
+  }
+
+  // O(1) nothrow
+  // All elements as a view, see view_type
+  view_type view() const noexcept {
+    return view_type(empty() ? end_node() : leftmost_, end_node(), this);
+  }
+
+  // O(h) strong
+  // The elements in [lo, hi) as a view
+  view_type view(const T& lo, const T& hi) const {
+    assert(!less(hi, lo));
+    sentinel_node* first = lower_bound_node(lo);
+    sentinel_node* last = lower_bound_node(hi);
+    return view_type(first ? first : end_node(), last ? last : end_node(), this);
+  }
+
+  // O(h + k) for k visited elements, basic
+  // Calls f for every element in [lo, hi) in order. No iterators are made, and with
+  // tracked_iterators f aborts if it modifies the set.
+  template <typename F>
+  void for_each(const T& lo, const T& hi, F f) const {
+    view_type range = view(lo, hi);
+    for (const T& element : range) {
+      f(element);
+    }
+  }
+
+  // O(m h) strong for m keys
+  // found[i] tells whether keys[i] is in the set. Up to 8 lookups walk the tree at once,
+  // so the cache misses of one are hidden behind the others, and no iterators are made.
+  void contains_many(const T* keys, std::size_t count, bool* found) const {
+    lower_bounds_grouped(keys, count, [&](std::size_t i, sentinel_node* n) {
+      found[i] = n && !less(keys[i], value(n));
+    });
+  }
+
+  // O(m h) strong for m keys
+  // result[i] points at the least element not less than keys[i], nullptr if there is none
+  void lower_bound_many(const T* keys, std::size_t count, const T** result) const {
+    lower_bounds_grouped(keys, count, [&](std::size_t i, sentinel_node* n) { result[i] = n ? &value(n) : nullptr; });
+  }
+
+  // O(h) strong, the order statistics functions below need the subtree_sizes policy
+  // The k-th smallest element counting from 0, end() if k >= size()
+  const_iterator nth(std::size_t k) const {
+    static_assert(has_order_statistics, "nth needs the subtree_sizes order statistics policy");
+    if (k >= size_) {
       return end();
     }
     sentinel_node* current = take_root();
-    sentinel_node* result = nullptr;
-
-    while (current != nullptr) {
-      if (static_cast<node*>(current)->value_ >= val) {
-        result = current;
+    while (true) {
+      std::size_t left = subtree_size(current->left);
+      if (k == left) {
+        return const_iterator(current, this);
+      }
+      if (k < left) {
         current = current->left;
       } else {
+        k -= left + 1;
         current = current->right;
       }
     }
+  }
+
+  // O(h) strong
+  // Number of elements less than val
+  std::size_t rank(const T& val) const {
+    return rank_of(val);
+  }
 
-    return result == nullptr ? end() : const_iterator(result, this);
+  // O(h) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  std::size_t rank(const K& key) const {
+    return rank_of(key);
   }
 
   // O(h) strong
-  const_iterator upper_bound(const T& val) const {
+  // Number of elements in [lo, hi)
+  std::size_t count_range(const T& lo, const T& hi) const {
+    return less(lo, hi) ? rank_of(hi) - rank_of(lo) : 0;
+  }
+
+  // O(h) strong
+  template <typename K, typename = std::enable_if_t<is_transparent_compare<Compare>::value, K>>
+  std::size_t count_range(const K& lo, const K& hi) const {
+    return less(lo, hi) ? rank_of(hi) - rank_of(lo) : 0;
+  }
+
+  // O(h) nothrow
+  // Position of the element at it, size() for end()
+  std::size_t index_of(const_iterator it) const noexcept {
+    static_assert(has_order_statistics, "index_of needs the subtree_sizes order statistics policy");
+    assert(it.node_ && it.belongs_to(this));
+    sentinel_node* current = it.node_;
+    if (current == &fake_) {
+      return size_;
+    }
+    std::size_t index = subtree_size(current->left);
+    for (sentinel_node* parent = current->parent(); parent != &fake_; parent = parent->parent()) {
+      if (current == parent->right) {
+        index += subtree_size(parent->left) + 1;
+      }
+      current = parent;
+    }
+    return index;
+  }
+
+  // O(h) nothrow
+  // The same as std::distance(first, last) without walking the elements in between
+  std::ptrdiff_t distance(const_iterator first, const_iterator last) const noexcept {
+    return static_cast<std::ptrdiff_t>(index_of(last)) - static_cast<std::ptrdiff_t>(index_of(first));
+  }
+
+  // O(h log n) strong, nothrow if Compare does not throw.
+  // Tracked iterators, or sets without subtree_sizes, add O(k) for the k moved elements.
+  // Moves the elements not less than key into greater, which must be empty.
+  // Nodes are relinked, iterators keep pointing at their elements, now in greater.
+  void split(const T& key, set& greater) {
+    assert(this != &greater && greater.empty());
+    change_guard guard{*this};
+    change_guard greater_guard{greater};
     if (empty()) {
-      return end();
+      return;
+    }
+    greater.can_take_nodes_from(*this);
+    if constexpr (inline_capacity > 0) {
+      std::uint64_t moving = 0;
+      for (std::size_t i = 0; i < inline_capacity; ++i) {
+        if ((fake_.used >> i & 1) && !less(value(fake_.slot(i)), key)) {
+          moving |= std::uint64_t(1) << i;
+        }
+      }
+      move_inline_nodes(&greater, moving);
+    }
+    sentinel_node* last = nullptr;
+    bool last_less = false;
+    for (sentinel_node* current = take_root(); current;) {
+      last = current;
+      last_less = less(value(current), key);
+      current = last_less ? current->right : current->left;
     }
-    sentinel_node* current = take_root();
-    sentinel_node* result = nullptr;
 
-    while (current != nullptr) {
-      if (static_cast<node*>(current)->value_ > val) {
-        result = current;
-        current = current->left;
+    sentinel_node* less = nullptr;
+    sentinel_node* not_less = nullptr;
+    split_path(last, last_less, less, not_less);
+    install_tree(less);
+    greater.install_tree(not_less);
+    if (!not_less) {
+      return;
+    }
+    if constexpr (has_order_statistics && !is_tracked) {
+      greater.size_ = subtree_size(not_less);
+    } else {
+      greater.size_ = greater.adopt_nodes(greater.leftmost_);
+    }
+    size_ -= greater.size_;
+  }
+
+  // O(h) nothrow, tracked iterators add O(k) for the k moved elements
+  // Appends all elements of greater, which must be greater than every element here.
+  // greater becomes empty, iterators keep pointing at their elements, now in this set.
+  // If the allocators differ, the elements are copied in O(k log n) instead, basic.
+  void join(set& greater) {
+    change_guard guard{*this};
+    change_guard greater_guard{greater};
+    if (this == &greater || greater.empty()) {
+      return;
+    }
+    assert(empty() || less(value(rightmost_), value(greater.leftmost_)));
+    if (!can_take_nodes_from(greater)) {
+      copy_missing_from(greater);
+      return;
+    }
+    greater.move_inline_nodes(this);
+
+    sentinel_node* pivot = greater.leftmost_;
+    sentinel_node* greatest = greater.rightmost_;
+    sentinel_node* before_pivot = rightmost_;
+    sentinel_node* after_pivot = pivot == greatest ? &fake_ : s_iterator::find_next(pivot);
+    std::size_t moved = greater.size_;
+    greater.unlink(pivot);
+    sentinel_node* right = greater.take_root();
+    if (right) {
+      right->set_parent(nullptr);
+    }
+    greater.forget_nodes();
+    sentinel_node* left = take_root();
+    if (left) {
+      left->set_parent(nullptr);
+    }
+    join_trees(left, pivot, right);
+    if (!left) {
+      leftmost_ = pivot;
+    }
+    rightmost_ = greatest;
+    size_ += moved;
+    link_in_order(pivot, before_pivot, after_pivot);
+    close_in_order();
+    if constexpr (is_tracked) {
+      adopt_nodes(pivot);
+    }
+  }
+
+  // O(h) nothrow
+  void join(set&& greater) {
+    join(greater);
+  }
+
+  // O(n + m), or O(m log n) when source is much smaller. Basic guarantee, nothrow if Compare does not throw.
+  // Moves the elements of source missing here into this set, the duplicates stay in source.
+  // Nodes are relinked, iterators keep pointing at their elements, now in this set.
+  // If the allocators differ, the elements are copied in O(m log n) instead.
+  void merge(set& source) {
+    change_guard guard{*this};
+    change_guard source_guard{source};
+    if (this == &source || source.empty()) {
+      return;
+    }
+    if (!can_take_nodes_from(source)) {
+      copy_missing_from(source);
+      return;
+    }
+    // The duplicates stay in source, so its inline nodes cannot be handed over to the slots here
+    source.move_inline_nodes(nullptr);
+    if (cheaper_one_by_one(source.size_, size_)) {
+      merge_one_by_one(source);
+    } else {
+      merge_linear(source);
+    }
+  }
+
+  // O(n + m) basic
+  void merge(set&& source) {
+    merge(source);
+  }
+
+  // O(n + m) basic
+  // Erases the elements missing from other
+  void intersect(const set& other) {
+    change_guard guard{*this};
+    if (this == &other || empty()) {
+      return;
+    }
+    if (other.empty()) {
+      clear();
+      return;
+    }
+    filter_linear(other, true);
+  }
+
+  // O(n + m), or O(m log n) when other is much smaller, basic
+  // Erases the elements present in other
+  void subtract(const set& other) {
+    change_guard guard{*this};
+    if (this == &other) {
+      clear();
+      return;
+    }
+    if (empty() || other.empty()) {
+      return;
+    }
+    if (!cheaper_one_by_one(other.size_, size_)) {
+      filter_linear(other, false);
+      return;
+    }
+    for (sentinel_node* current = other.leftmost_; current;) {
+      sentinel_node* next = current == other.rightmost_ ? nullptr : s_iterator::find_next(current);
+      if (sentinel_node* found = find_node(value(current))) {
+        erase_node(found);
+      }
+      current = next;
+    }
+  }
+
+  // O(h), O(n log n), or O(n log n + i) for i registered iterators, see validation_level
+  // Checks the invariants of the set and returns false if one is broken, for assert(s.validate())
+  // in tests. The path level checks a different path as the set changes.
+  bool validate(validation_level level = validation_level::full) const {
+    switch (level) {
+    case validation_level::path:
+      return check_path(mix(size_ ^ reinterpret_cast<std::uintptr_t>(take_root())));
+    case validation_level::structure:
+      return check_structure(false);
+    case validation_level::full:
+      return check_structure(true);
+    }
+    return false;
+  }
+
+  // O(1) nothrow, needs the operation_counters counters policy
+  // A snapshot of the counters, for exporting to a metrics system
+  set_counters stats() const noexcept {
+    static_assert(is_counted, "stats needs the operation_counters counters policy");
+    return this->counters_;
+  }
+
+  // O(1) nothrow, needs the operation_counters counters policy
+  void reset_stats() noexcept {
+    static_assert(is_counted, "reset_stats needs the operation_counters counters policy");
+    this->counters_ = set_counters();
+  }
+
+  // O(n) nothrow, O(1) for AVL trees
+  // Number of levels of the tree, 0 for an empty set. Walks by parent pointers, without recursion.
+  std::size_t height() const noexcept {
+    if (empty()) {
+      return 0;
+    }
+    if constexpr (is_avl) {
+      return static_cast<std::size_t>(height(take_root()));
+    }
+    std::size_t depth = 1;
+    std::size_t result = 0;
+    const sentinel_node* from = &fake_;
+    const sentinel_node* current = take_root();
+    while (current != &fake_) {
+      const sentinel_node* next;
+      if (from == current->parent()) {
+        result = std::max(result, depth);
+        next = current->left ? current->left : current->right ? current->right : current->parent();
+      } else if (from == current->left && current->right) {
+        next = current->right;
       } else {
-        current = current->right;
+        next = current->parent();
+      }
+      if (next == current->parent()) {
+        --depth;
+      } else {
+        ++depth;
       }
+      from = current;
+      current = next;
     }
+    return result;
+  }
 
-    return result == nullptr ? end() : const_iterator(result, this);
+  // O(1)
+  key_compare key_comp() const {
+    return comp();
   }
 
-  // O(1) nothrow
-  friend void swap(set& lhs, set& rhs) noexcept {
+  // O(1)
+  value_compare value_comp() const {
+    return comp();
+  }
+
+  // O(1) nothrow, with tracked_iterators O(n) or O(m) for each side with an iterator at an element,
+  // as every node of that side is visited to point its iterators at the other set.
+  // Iterators of the elements follow them to the other set, end() iterators stay with their set.
+  // With inline_nodes the elements in inline nodes are first moved into the slots of the other set,
+  // or to the heap for those that do not fit or if moving T may throw, strong.
+  friend void swap(set& lhs, set& rhs) noexcept(inline_capacity == 0) {
+    change_guard lhs_guard{lhs};
+    change_guard rhs_guard{rhs};
+    lhs.modify_assert();
+    rhs.modify_assert();
+    if constexpr (inline_capacity > 0) {
+      std::uint64_t theirs = rhs.fake_.used;
+      lhs.move_inline_nodes(&rhs);
+      rhs.move_inline_nodes(&lhs, theirs);
+    }
     sentinel_node* lhs_root = lhs.take_root();
     sentinel_node* rhs_left = rhs.take_root();
-    swap(lhs.fake_, rhs.fake_);
+    swap(static_cast<sentinel_node&>(lhs.fake_), static_cast<sentinel_node&>(rhs.fake_));
+    std::swap(lhs.leftmost_, rhs.leftmost_);
+    std::swap(lhs.rightmost_, rhs.rightmost_);
     std::swap(lhs.size_, rhs.size_);
+    // A range stays with one set, and a moved-from set is left without one
+    std::swap(lhs.next_stamp_, rhs.next_stamp_);
+    using std::swap;
+    swap(lhs.comp(), rhs.comp());
+    // The nodes always travel together with the allocator that owns them
+    swap(lhs.alloc_, rhs.alloc_);
     if (lhs_root) {
-      lhs_root->parent = &rhs.fake_;
+      lhs_root->set_parent(&rhs.fake_);
     }
     if (rhs_left) {
-      rhs_left->parent = &lhs.fake_;
+      rhs_left->set_parent(&lhs.fake_);
+    }
+    lhs.close_in_order();
+    rhs.close_in_order();
+    if constexpr (is_tracked) {
+      // The nodes of each side are now in the other set, still counted by their old one
+      std::size_t theirs = rhs.element_iterators_;
+      if (lhs.element_iterators_ != 0) {
+        rhs.adopt_all();
+      }
+      if (theirs != 0) {
+        lhs.adopt_all();
+      }
     }
   }
 };
\ No newline at end of file
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Executors for the parallel operations of set in parallel_set.h. An executor is any callable
+// that takes a std::function<void()> and runs it once, on whatever thread and at whatever time
+// it likes.
+
+// A fixed number of worker threads taking tasks in the order they were submitted.
+// Tasks must not throw. The destructor runs the tasks still queued and joins the workers.
+class thread_pool {
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<std::function<void()>> tasks_;
+  bool stopping_{false};
+  std::vector<std::thread> workers_;
+
+  void work() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+        if (tasks_.empty()) {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+public:
+  // A pool of hardware_concurrency() threads, or one if that is unknown
+  thread_pool() : thread_pool(std::max(1u, std::thread::hardware_concurrency())) {}
+
+  explicit thread_pool(std::size_t threads) {
+    workers_.reserve(threads);
+    try {
+      for (std::size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this] { work(); });
+      }
+    } catch (...) {
+      stop();
+      throw;
+    }
+  }
+
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  ~thread_pool() {
+    stop();
+  }
+
+  // Queues the task for the first free worker
+  void operator()(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    ready_.notify_one();
+  }
+
+  std::size_t size() const noexcept {
+    return workers_.size();
+  }
+
+private:
+  void stop() noexcept {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    ready_.notify_all();
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+    workers_.clear();
+  }
+};
+
+// Runs every task right away in the calling thread, for tests and single-threaded builds
+struct inline_executor {
+  void operator()(const std::function<void()>& task) const {
+    task();
+  }
+};
+
+// Runs f(0), ..., f(count - 1) and waits for all of them: f(0) in the calling thread, the others
+// through executor. Once all have finished, the first exception one of them threw is rethrown.
+// The calls must not wait for each other, and with a pool the caller must not be one of its
+// tasks, or the pool may have no thread left to run the others.
+template <typename Executor, typename F>
+void run_parallel(Executor& executor, std::size_t count, F f) {
+  std::mutex mutex;
+  std::condition_variable done;
+  std::size_t running = count;
+  std::exception_ptr failure;
+
+  auto finish = [&](std::exception_ptr error, std::size_t calls) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (error && !failure) {
+      failure = error;
+    }
+    running -= calls;
+    // Notified under the lock, so the waiting caller cannot return and destroy done first
+    done.notify_one();
+  };
+  auto call = [&](std::size_t i) {
+    std::exception_ptr error;
+    try {
+      f(i);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    finish(error, 1);
+  };
+
+  for (std::size_t i = 1; i < count; ++i) {
+    try {
+      executor(std::function<void()>([&call, i] { call(i); }));
+    } catch (...) {
+      finish(std::current_exception(), count - i);
+      break;
+    }
+  }
+  if (count != 0) {
+    call(0);
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [&] { return running == 0; });
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+}
@@ -0,0 +1,83 @@
+#include "btree_set.h"
+#include "set.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <vector>
+
+namespace {
+
+template <typename Config>
+class BatchLookupTest : public set_fixture<Config> {};
+
+TYPED_TEST_SUITE(BatchLookupTest, set_configs);
+
+TYPED_TEST(BatchLookupTest, MatchesSingleLookups) {
+  using set_type = typename TestFixture::set_type;
+  std::set<int> elements;
+  for (int i = 0; i < 500; ++i) {
+    elements.insert(this->random_key(2000));
+  }
+  set_type s = this->make(elements);
+  std::vector<int> keys;
+  for (int i = 0; i < 300; ++i) {
+    keys.push_back(this->random_key(2100));
+  }
+  std::vector<char> found(keys.size());
+  std::vector<const int*> bounds(keys.size());
+  s.contains_many(keys.data(), keys.size(), reinterpret_cast<bool*>(found.data()));
+  s.lower_bound_many(keys.data(), keys.size(), bounds.data());
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(found[i] != 0, elements.count(keys[i]) == 1);
+    auto expected = elements.lower_bound(keys[i]);
+    if (expected == elements.end()) {
+      EXPECT_EQ(bounds[i], nullptr);
+    } else {
+      ASSERT_NE(bounds[i], nullptr);
+      EXPECT_EQ(*bounds[i], *expected);
+    }
+  }
+}
+
+TEST(BatchLookupTest, EmptyBatchesAndEmptySets) {
+  set<int> s;
+  const int key = 1;
+  bool found = true;
+  const int* bound = &key;
+  s.contains_many(&key, 1, &found);
+  s.lower_bound_many(&key, 1, &bound);
+  EXPECT_FALSE(found);
+  EXPECT_EQ(bound, nullptr);
+  s.insert(1);
+  s.contains_many(nullptr, 0, nullptr);
+  s.lower_bound_many(nullptr, 0, nullptr);
+}
+
+// Many more keys than lookups in flight at once, some of them repeated
+TEST(BatchLookupTest, BtreeSetMatchesSingleLookups) {
+  btree_set<int> s;
+  for (int i = 0; i < 5000; i += 3) {
+    s.insert(i);
+  }
+  std::vector<int> keys;
+  for (int i = 0; i < 1000; ++i) {
+    keys.push_back(i * 37 % 5003);
+    keys.push_back(i);
+  }
+  std::vector<char> found(keys.size());
+  std::vector<const int*> bounds(keys.size());
+  s.contains_many(keys.data(), keys.size(), reinterpret_cast<bool*>(found.data()));
+  s.lower_bound_many(keys.data(), keys.size(), bounds.data());
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    ASSERT_EQ(found[i] != 0, s.contains(keys[i]));
+    auto lower = s.lower_bound(keys[i]);
+    ASSERT_EQ(bounds[i] == nullptr, lower == s.end());
+    if (bounds[i]) {
+      ASSERT_EQ(*bounds[i], *lower);
+    }
+  }
+}
+
+} // namespace
@@ -0,0 +1,82 @@
+#include "btree_set.h"
+#include "mutable_set_tests.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <utility>
+
+namespace {
+
+struct unchecked_policy : default_set_policy {
+  using iterators = unchecked_iterators;
+};
+
+using btree_sets = ::testing::Types<btree_set<int>, btree_set<int, std::less<int>, std::allocator<int>, unchecked_policy>,
+                                    btree_set<long>>;
+
+INSTANTIATE_TYPED_TEST_SUITE_P(BtreeSet, MutableSetTest, btree_sets);
+
+INSTANTIATE_TYPED_TEST_SUITE_P(BtreeSet, InvalidatingSetDeathTest, btree_set<int>);
+
+// Enough elements for a tree three levels high, so splits and merges reach the inner nodes
+TEST(BtreeSetTest, SplitsAndMergesInnerNodes) {
+  btree_set<int> s;
+  std::set<int> expected;
+  const int count = static_cast<int>(btree_set<int>::node_capacity * btree_set<int>::node_capacity * 2);
+  for (int i = 0; i < count; ++i) {
+    s.insert(i * 7 % count);
+    expected.insert(i * 7 % count);
+  }
+  ASSERT_TRUE(std::equal(s.begin(), s.end(), expected.begin(), expected.end()));
+  for (int i = 0; i < count; i += 2) {
+    s.erase(i);
+    expected.erase(i);
+  }
+  EXPECT_EQ(s.size(), expected.size());
+  EXPECT_TRUE(std::equal(s.begin(), s.end(), expected.begin(), expected.end()));
+  EXPECT_TRUE(std::equal(s.rbegin(), s.rend(), expected.rbegin(), expected.rend()));
+}
+
+// Right hints land in leaves and before separators of inner nodes, wrong ones fall back to the search
+TEST(BtreeSetTest, HintedInsertion) {
+  btree_set<int> s;
+  std::set<int> expected;
+  const int count = static_cast<int>(btree_set<int>::node_capacity * btree_set<int>::node_capacity * 2);
+  for (int i = 0; i < count; i += 2) {
+    EXPECT_EQ(*s.insert(s.end(), i), i);
+    expected.insert(i);
+  }
+  std::mt19937 rng(5);
+  for (int i = 0; i < count; ++i) {
+    int key = static_cast<int>(rng() % (count + 10)) - 5;
+    auto hint = rng() % 3 == 0 ? s.begin() : s.lower_bound(key);
+    EXPECT_EQ(*s.insert(hint, key), key);
+    expected.insert(key);
+  }
+  EXPECT_EQ(s.size(), expected.size());
+  EXPECT_TRUE(std::equal(s.begin(), s.end(), expected.begin(), expected.end()));
+  EXPECT_TRUE(std::equal(s.rbegin(), s.rend(), expected.rbegin(), expected.rend()));
+}
+
+TEST(BtreeSetTest, MoveTakesTheTree) {
+  btree_set<int> a;
+  for (int i = 0; i < 1000; ++i) {
+    a.insert(i);
+  }
+  btree_set<int> b(std::move(a));
+  EXPECT_TRUE(a.empty());
+  EXPECT_EQ(b.size(), 1000u);
+  btree_set<int> c;
+  c.insert(-1);
+  c = std::move(b);
+  EXPECT_TRUE(b.empty());
+  EXPECT_EQ(c.size(), 1000u);
+  EXPECT_EQ(*c.begin(), 0);
+  b = c;
+  EXPECT_EQ(b.size(), 1000u);
+}
+
+} // namespace
@@ -0,0 +1,55 @@
+#include "set.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+namespace {
+
+template <typename Config>
+class BulkBuildTest : public set_fixture<Config> {};
+
+TYPED_TEST_SUITE(BulkBuildTest, set_configs);
+
+TYPED_TEST(BulkBuildTest, SortedRangesAndAssignSorted) {
+  using set_type = typename TestFixture::set_type;
+  std::vector<int> sorted(1000);
+  for (int i = 0; i < 1000; ++i) {
+    sorted[i] = 2 * i;
+  }
+  std::set<int> expected(sorted.begin(), sorted.end());
+  set_type built(sorted_unique, sorted.begin(), sorted.end());
+  this->expect_same(built, expected);
+
+  std::vector<int> shuffled = sorted;
+  std::shuffle(shuffled.begin(), shuffled.end(), this->rng);
+  shuffled.insert(shuffled.end(), sorted.begin(), sorted.begin() + 100);
+  set_type from_range(shuffled.begin(), shuffled.end());
+  this->expect_same(from_range, expected);
+
+  std::vector<int> odd{1, 3, 5};
+  built.assign_sorted(odd.begin(), odd.end());
+  this->expect_same(built, {1, 3, 5});
+}
+
+// A hint right after the new element saves the search, so sorted input costs O(1) per element
+TEST(HintedInsertTest, SortedInputTakesAConstantNumberOfComparisons) {
+  set<int, std::less<int>, std::allocator<int>, counted_policy> s;
+  const int count = 1000;
+  for (int i = 0; i < count; ++i) {
+    s.insert(s.end(), i);
+  }
+  EXPECT_LE(s.stats().comparisons, 2u * count);
+  s.reset_stats();
+  for (int i = -1; i >= -count; --i) {
+    s.insert(s.begin(), i);
+  }
+  EXPECT_LE(s.stats().comparisons, 2u * count);
+  EXPECT_EQ(s.size(), 2u * count);
+  EXPECT_TRUE(s.validate(validation_level::full));
+}
+
+} // namespace
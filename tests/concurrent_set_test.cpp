@@ -0,0 +1,104 @@
+#include "concurrent_set.h"
+#include "set.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+TEST(ConcurrentSetTest, ReadersSeeConsistentContents) {
+  // Even keys are always there, the writer inserts and erases odd ones
+  set<int> init;
+  for (int i = 0; i < 2000; i += 2) {
+    init.insert(i);
+  }
+  concurrent_set<int> shared(init);
+  std::atomic<bool> stop{false};
+  std::atomic<int> failures{0};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 3; ++r) {
+    readers.emplace_back([&, r] {
+      concurrent_set<int>::reader reader = shared.make_reader();
+      std::mt19937 rng(r);
+      while (!stop.load()) {
+        int even = static_cast<int>(rng() % 1000) * 2;
+        if (!reader.contains(even) || reader.lower_bound(even) != even) {
+          ++failures;
+        }
+        if (reader.size() < 1000) {
+          ++failures;
+        }
+      }
+    });
+  }
+  std::set<int> odd;
+  std::mt19937 rng(9);
+  for (int i = 0; i < 3000; ++i) {
+    int key = static_cast<int>(rng() % 1000) * 2 + 1;
+    if (rng() % 2) {
+      EXPECT_EQ(shared.insert(key), odd.insert(key).second);
+    } else {
+      EXPECT_EQ(shared.erase(key), odd.erase(key));
+    }
+  }
+  stop = true;
+  for (std::thread& t : readers) {
+    t.join();
+  }
+  EXPECT_EQ(failures.load(), 0);
+  const set<int>& contents = shared.unsafe_get();
+  EXPECT_EQ(contents.size(), 1000 + odd.size());
+  EXPECT_TRUE(contents.validate(validation_level::full));
+  for (int key : odd) {
+    EXPECT_TRUE(contents.contains(key));
+  }
+}
+
+// The front copy after one more update is the one the failed call was made on
+TEST(ConcurrentSetTest, FailedSecondCallKeepsThePublishedChange) {
+  concurrent_set<int> shared;
+  int calls = 0;
+  bool inserted = shared.update([&](set<int>& s) {
+    if (++calls == 2) {
+      throw std::runtime_error("second call");
+    }
+    return s.insert(1).second;
+  });
+  EXPECT_TRUE(inserted);
+  EXPECT_TRUE(shared.unsafe_get().contains(1));
+  EXPECT_TRUE(shared.insert(2));
+  for (int i = 0; i < 2; ++i) {
+    const set<int>& contents = shared.unsafe_get();
+    EXPECT_EQ(contents.size(), 2u);
+    EXPECT_TRUE(contents.contains(1));
+    EXPECT_TRUE(contents.contains(2));
+    // Flips the front
+    EXPECT_FALSE(shared.insert(2));
+  }
+}
+
+TEST(ConcurrentSetTest, FailedFirstCallPublishesNothing) {
+  set<int> init;
+  init.insert(1);
+  concurrent_set<int> shared(init);
+  EXPECT_THROW(shared.update([](set<int>& s) {
+    s.insert(2);
+    throw std::runtime_error("first call");
+  }),
+               std::runtime_error);
+  EXPECT_EQ(shared.unsafe_get().size(), 1u);
+  EXPECT_TRUE(shared.insert(3));
+  EXPECT_EQ(shared.unsafe_get().size(), 2u);
+  EXPECT_TRUE(shared.insert(4));
+  const set<int>& contents = shared.unsafe_get();
+  EXPECT_EQ(contents.size(), 3u);
+  EXPECT_FALSE(contents.contains(2));
+}
+
+} // namespace
@@ -0,0 +1,58 @@
+#include "set.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+
+#include <iterator>
+
+namespace {
+
+using counted_set = set<int, std::less<int>, std::allocator<int>, counted_policy>;
+
+TEST(CountersTest, SeeEveryNode) {
+  set<int, std::less<int>, std::allocator<int>, counted_policy> s;
+  for (int i = 0; i < 100; ++i) {
+    s.insert(i);
+  }
+  EXPECT_EQ(s.stats().node_allocations, 100u);
+  EXPECT_GT(s.stats().comparisons, 0u);
+  s.clear();
+  EXPECT_EQ(s.stats().node_frees, 100u);
+  s.reset_stats();
+  EXPECT_EQ(s.stats().comparisons, 0u);
+}
+
+TEST(CountersTest, SearchesAndIteratorSteps) {
+  counted_set s;
+  for (int i = 0; i < 1023; ++i) {
+    s.insert(i);
+  }
+  s.reset_stats();
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(s.contains(i));
+  }
+  set_counters stats = s.stats();
+  EXPECT_EQ(stats.searches, 100u);
+  // A red-black tree of 1023 nodes is at most 2 log2(1024) levels high
+  EXPECT_GE(stats.search_steps, 100u);
+  EXPECT_LE(stats.search_steps, 100u * 20);
+
+  s.reset_stats();
+  EXPECT_EQ(std::distance(s.begin(), s.end()), 1023);
+  EXPECT_EQ(s.stats().iterator_steps, 1023u);
+  EXPECT_GT(s.stats().iterator_registrations, 0u);
+}
+
+TEST(CountersTest, MaxDepthOfAnUnbalancedTree) {
+  struct policy : counted_policy {
+    using balance = no_balance;
+  };
+  set<int, std::less<int>, std::allocator<int>, policy> s;
+  for (int i = 0; i < 100; ++i) {
+    s.insert(i);
+  }
+  EXPECT_EQ(s.stats().max_depth, 100u);
+  EXPECT_EQ(s.height(), 100u);
+}
+
+} // namespace
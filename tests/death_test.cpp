@@ -0,0 +1,81 @@
+#include "set.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// The debug iterator contract: with tracked or generation checked iterators every misuse aborts
+// by assert instead of being undefined behaviour. The tests build with asserts in every build type.
+
+namespace {
+
+struct generation_policy : default_set_policy {
+  using iterators = generation_checked_iterators;
+};
+
+struct linked_generation_policy : generation_policy {
+  using traversal = linked_traversal;
+};
+
+template <typename Policy>
+using int_set = set<int, std::less<int>, std::allocator<int>, Policy>;
+
+template <typename Set>
+class CheckedIteratorDeathTest : public ::testing::Test {
+protected:
+  Set s;
+
+  void SetUp() override {
+    for (int i = 0; i < 10; ++i) {
+      s.insert(i);
+    }
+  }
+};
+
+using checked_sets = ::testing::Types<int_set<default_set_policy>, int_set<generation_policy>,
+                                      int_set<linked_generation_policy>>;
+
+TYPED_TEST_SUITE(CheckedIteratorDeathTest, checked_sets);
+
+TYPED_TEST(CheckedIteratorDeathTest, DereferencingEnd) {
+  EXPECT_DEATH(static_cast<void>(*this->s.end()), "");
+}
+
+TYPED_TEST(CheckedIteratorDeathTest, IncrementingEnd) {
+  EXPECT_DEATH(++this->s.end(), "");
+}
+
+TYPED_TEST(CheckedIteratorDeathTest, DecrementingBegin) {
+  EXPECT_DEATH(--this->s.begin(), "");
+}
+
+TYPED_TEST(CheckedIteratorDeathTest, UsingAnIteratorToAnErasedElement) {
+  auto it = this->s.find(5);
+  this->s.erase(5);
+  EXPECT_DEATH(static_cast<void>(*it), "");
+  EXPECT_DEATH(++it, "");
+}
+
+TYPED_TEST(CheckedIteratorDeathTest, UsingAnIteratorToAnExtractedElement) {
+  auto it = this->s.find(5);
+  auto nh = this->s.extract(it);
+  EXPECT_DEATH(static_cast<void>(*it), "");
+}
+
+TYPED_TEST(CheckedIteratorDeathTest, UsingAnIteratorAfterClear) {
+  auto it = this->s.find(5);
+  this->s.clear();
+  EXPECT_DEATH(static_cast<void>(*it), "");
+}
+
+TYPED_TEST(CheckedIteratorDeathTest, UsingADefaultConstructedIterator) {
+  typename TypeParam::iterator it;
+  EXPECT_DEATH(static_cast<void>(*it), "");
+}
+
+} // namespace
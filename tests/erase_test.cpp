@@ -0,0 +1,66 @@
+#include "set.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+
+#include <iterator>
+#include <set>
+#include <utility>
+
+namespace {
+
+template <typename Config>
+class EraseTest : public set_fixture<Config> {};
+
+TYPED_TEST_SUITE(EraseTest, set_configs);
+
+TYPED_TEST(EraseTest, EraseIf) {
+  using set_type = typename TestFixture::set_type;
+  std::set<int> elements;
+  for (int i = 0; i < 100; ++i) {
+    elements.insert(i);
+  }
+  set_type s = this->make(elements);
+  EXPECT_EQ(erase_if(s, [](int x) { return x % 3 == 0; }), 34u);
+  for (auto it = elements.begin(); it != elements.end();) {
+    it = *it % 3 == 0 ? elements.erase(it) : std::next(it);
+  }
+  this->expect_same(s, elements);
+  EXPECT_EQ(erase_if(s, [](int) { return false; }), 0u);
+  this->expect_same(s, elements);
+}
+
+TYPED_TEST(EraseTest, RangeErase) {
+  using set_type = typename TestFixture::set_type;
+  std::set<int> elements;
+  for (int i = 0; i < 200; ++i) {
+    elements.insert(this->random_key(1000));
+  }
+  set_type s = this->make(elements);
+  for (auto [lo, hi] : {std::pair{400, 400}, std::pair{100, 300}, std::pair{-1, 50}, std::pair{900, 1000},
+                        std::pair{500, 700}}) {
+    auto next = s.erase(s.lower_bound(lo), s.lower_bound(hi));
+    auto expected_next = elements.erase(elements.lower_bound(lo), elements.lower_bound(hi));
+    ASSERT_EQ(next == s.end(), expected_next == elements.end());
+    if (next != s.end()) {
+      ASSERT_EQ(*next, *expected_next);
+    }
+    this->expect_same(s, elements);
+  }
+  EXPECT_TRUE(s.erase(s.begin(), s.end()) == s.end());
+  this->expect_same(s, {});
+}
+
+TEST(RangeEraseTest, FreesOnlyTheErasedNodes) {
+  set<int, std::less<int>, std::allocator<int>, counted_policy> s;
+  for (int i = 0; i < 1000; ++i) {
+    s.insert(i);
+  }
+  s.reset_stats();
+  s.erase(s.find(100), s.find(400));
+  EXPECT_EQ(s.stats().node_frees, 300u);
+  EXPECT_EQ(s.size(), 700u);
+  EXPECT_TRUE(s.validate(validation_level::full));
+}
+
+} // namespace
@@ -0,0 +1,141 @@
+#include "flat_set.h"
+#include "mutable_set_tests.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct unchecked_policy : default_set_policy {
+  using iterators = unchecked_iterators;
+};
+
+using flat_sets = ::testing::Types<flat_set<int>, flat_set<int, std::less<int>, std::allocator<int>, unchecked_policy>,
+                                   flat_set<std::string>>;
+
+INSTANTIATE_TYPED_TEST_SUITE_P(FlatSet, MutableSetTest, flat_sets);
+
+INSTANTIATE_TYPED_TEST_SUITE_P(FlatSet, InvalidatingSetDeathTest, flat_set<int>);
+
+TEST(FlatSetTest, StrongGuaranteeKeepsIterators) {
+  struct fragile {
+    int value;
+    fragile(int v) : value(v) {}
+    fragile(const fragile& other) : value(other.value) {
+      if (value < 0) {
+        throw std::runtime_error("copy");
+      }
+    }
+    fragile& operator=(const fragile&) = default;
+    bool operator<(const fragile& other) const {
+      return value < other.value;
+    }
+  };
+  flat_set<fragile> s;
+  s.insert(fragile(1));
+  s.insert(fragile(3));
+  auto it = s.find(fragile(3));
+  EXPECT_THROW(s.insert(fragile(-1)), std::runtime_error);
+  EXPECT_EQ(s.size(), 2u);
+  EXPECT_EQ(it->value, 3);
+}
+
+TEST(FlatSetTest, MovedIteratorsKeepTheirElements) {
+  flat_set<int> a;
+  a.insert(1);
+  a.insert(2);
+  auto it = a.find(2);
+  flat_set<int> b(std::move(a));
+  EXPECT_TRUE(a.empty());
+  EXPECT_EQ(*it, 2);
+  EXPECT_TRUE(it == b.find(2));
+  flat_set<int> c;
+  c = std::move(b);
+  EXPECT_EQ(*it, 2);
+  EXPECT_TRUE(it == c.find(2));
+}
+
+// Stays with its set on move assignment, and two of them only share memory if their ids match
+template <typename T>
+struct pinned_allocator {
+  using value_type = T;
+  using propagate_on_container_move_assignment = std::false_type;
+
+  int id;
+
+  explicit pinned_allocator(int i) noexcept : id(i) {}
+
+  template <typename U>
+  pinned_allocator(const pinned_allocator<U>& other) noexcept : id(other.id) {}
+
+  T* allocate(std::size_t n) {
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, std::size_t n) noexcept {
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template <typename U>
+  bool operator==(const pinned_allocator<U>& other) const noexcept {
+    return id == other.id;
+  }
+
+  template <typename U>
+  bool operator!=(const pinned_allocator<U>& other) const noexcept {
+    return id != other.id;
+  }
+};
+
+using pinned_set = flat_set<int, std::less<int>, pinned_allocator<int>>;
+
+TEST(FlatSetTest, MoveAssignmentKeepsAPinnedAllocator) {
+  pinned_set a(pinned_allocator<int>(1));
+  pinned_set b(pinned_allocator<int>(2));
+  a.insert(10);
+  for (int i = 0; i < 5; ++i) {
+    b.insert(i);
+  }
+  a = std::move(b);
+  EXPECT_EQ(a.get_allocator().id, 1);
+  EXPECT_EQ(b.get_allocator().id, 2);
+  EXPECT_TRUE(b.empty());
+  std::vector<int> expected{0, 1, 2, 3, 4};
+  EXPECT_TRUE(std::equal(a.begin(), a.end(), expected.begin(), expected.end()));
+
+  // Equal allocators hand the array over with its iterators
+  pinned_set c(pinned_allocator<int>(1));
+  auto it = a.find(3);
+  c = std::move(a);
+  EXPECT_EQ(*it, 3);
+  EXPECT_TRUE(it == c.find(3));
+}
+
+TEST(FlatSetDeathTest, MoveAssignmentBetweenPinnedAllocatorsInvalidatesIterators) {
+  pinned_set a(pinned_allocator<int>(1));
+  pinned_set b(pinned_allocator<int>(2));
+  b.insert(1);
+  auto it = b.begin();
+  a = std::move(b);
+  EXPECT_DEATH(static_cast<void>(*it), "");
+}
+
+TEST(FlatSetTest, SortedUniqueBuildAndLookups) {
+  std::vector<int> sorted{1, 4, 9, 16};
+  flat_set<int> s(sorted_unique, sorted.begin(), sorted.end());
+  EXPECT_EQ(s.size(), 4u);
+  EXPECT_TRUE(s.contains(9));
+  EXPECT_FALSE(s.contains(10));
+  EXPECT_EQ(*s.lower_bound(10), 16);
+  EXPECT_TRUE(s.upper_bound(16) == s.end());
+}
+
+} // namespace
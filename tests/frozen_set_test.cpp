@@ -0,0 +1,43 @@
+#include "btree_set.h"
+#include "flat_set.h"
+#include "frozen_set.h"
+#include "set.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+
+namespace {
+
+TEST(FrozenSetTest, MatchesTheSetItWasFrozenFrom) {
+  for (int count : {0, 1, 2, 7, 100, 1000}) {
+    set<int> s;
+    std::set<int> expected = random_contents(s, count, 3 * count + 1, count);
+    expect_lookups(freeze(s), expected, 3 * count + 1);
+    btree_set<int> b(s.begin(), s.end());
+    expect_lookups(freeze(b), expected, 3 * count + 1);
+    flat_set<int> f(s.begin(), s.end());
+    frozen_set<int> frozen = freeze(f);
+    frozen_set<int> copy(frozen);
+    expect_lookups(copy, expected, 3 * count + 1);
+  }
+}
+
+TEST(FrozenSetTest, StringElements) {
+  set<std::string> s;
+  for (int i = 0; i < 300; ++i) {
+    s.insert(std::to_string(i * 7));
+  }
+  frozen_set<std::string> f = freeze(s);
+  ASSERT_EQ(f.size(), s.size());
+  EXPECT_TRUE(std::equal(f.begin(), f.end(), s.begin(), s.end()));
+  for (int i = 0; i < 2100; ++i) {
+    std::string key = std::to_string(i);
+    ASSERT_EQ(f.contains(key), s.contains(key));
+  }
+}
+
+} // namespace
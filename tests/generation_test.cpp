@@ -0,0 +1,181 @@
+#include "set.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Generation checked iterators carry the stamp of their node, erase and extract change it
+
+namespace {
+
+struct generation_policy : default_set_policy {
+  using iterators = generation_checked_iterators;
+};
+
+struct linked_generation_policy : generation_policy {
+  using traversal = linked_traversal;
+};
+
+using generation_set = set<int, std::less<int>, std::allocator<int>, generation_policy>;
+
+static_assert(std::is_trivially_copyable_v<generation_set::iterator>);
+static_assert(std::is_trivially_copyable_v<generation_set::const_iterator>);
+
+TEST(GenerationStampTest, IteratorsOfLiveNodesStayValid) {
+  generation_set s;
+  for (int i = 0; i < 100; ++i) {
+    s.insert(i);
+  }
+  auto it = s.find(50);
+  // Other nodes come and go, and the tree rebalances under the iterator
+  for (int i = 100; i < 1000; ++i) {
+    s.insert(i);
+  }
+  for (int i = 0; i < 50; ++i) {
+    s.erase(i);
+  }
+  EXPECT_EQ(*it, 50);
+  EXPECT_TRUE(it == s.begin());
+  generation_set other;
+  swap(s, other);
+  EXPECT_EQ(*it, 50);
+  EXPECT_TRUE(it == other.begin());
+}
+
+TEST(GenerationStampTest, OnlySetsWithNodesTakeARange) {
+  std::uintptr_t before = generation_ranges.load();
+  {
+    generation_set empty;
+    generation_set moved(std::move(empty));
+    generation_set assigned;
+    assigned = std::move(moved);
+    EXPECT_TRUE(assigned.end() == assigned.begin());
+  }
+  EXPECT_EQ(generation_ranges.load(), before);
+  generation_set s;
+  s.insert(1);
+  s.insert(2);
+  s.erase(1);
+  EXPECT_EQ(generation_ranges.load(), before + 1);
+  generation_set moved(std::move(s));
+  moved.insert(3);
+  EXPECT_EQ(generation_ranges.load(), before + 1);
+}
+
+TEST(GenerationStampDeathTest, RunningOutOfRangesAborts) {
+  EXPECT_DEATH(
+      {
+        generation_ranges.store(std::numeric_limits<std::uintptr_t>::max() >> (4 * sizeof(std::uintptr_t)));
+        generation_set s;
+        s.insert(1);
+      },
+      "used up");
+}
+
+TEST(GenerationStampDeathTest, ReinsertedNodesGetANewStamp) {
+  generation_set s;
+  s.insert(1);
+  s.insert(2);
+  auto it = s.find(1);
+  auto nh = s.extract(it);
+  auto reinserted = s.insert(std::move(nh)).position;
+  EXPECT_EQ(*reinserted, 1);
+  EXPECT_DEATH(static_cast<void>(*it), "");
+}
+
+// Keeps freed memory untouched until the last copy of the allocator is gone, so the test sees
+// the stamp that the set left in a dead node and not what the heap wrote over it
+template <typename T>
+class quarantine_allocator {
+  template <typename U>
+  friend class quarantine_allocator;
+
+  struct quarantine {
+    std::vector<void*> freed;
+
+    ~quarantine() {
+      for (void* p : freed) {
+        ::operator delete(p);
+      }
+    }
+  };
+
+  std::shared_ptr<quarantine> freed_ = std::make_shared<quarantine>();
+
+public:
+  using value_type = T;
+
+  quarantine_allocator() = default;
+
+  template <typename U>
+  quarantine_allocator(const quarantine_allocator<U>& other) noexcept : freed_(other.freed_) {}
+
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, std::size_t) noexcept {
+    freed_->freed.push_back(p);
+  }
+
+  template <typename U>
+  bool operator==(const quarantine_allocator<U>& other) const noexcept {
+    return freed_ == other.freed_;
+  }
+
+  template <typename U>
+  bool operator!=(const quarantine_allocator<U>& other) const noexcept {
+    return freed_ != other.freed_;
+  }
+};
+
+template <typename Set>
+class GenerationStampDeathTest : public ::testing::Test {
+protected:
+  Set s;
+
+  void SetUp() override {
+    for (int i = 0; i < 10; ++i) {
+      s.insert(i);
+    }
+  }
+};
+
+template <typename Policy>
+using quarantined_set = set<int, std::less<int>, quarantine_allocator<int>, Policy>;
+
+using stamped_sets = ::testing::Types<quarantined_set<generation_policy>, quarantined_set<linked_generation_policy>>;
+
+TYPED_TEST_SUITE(GenerationStampDeathTest, stamped_sets);
+
+TYPED_TEST(GenerationStampDeathTest, ErasedNodesAreStampedDead) {
+  auto first = this->s.find(0);
+  auto middle = this->s.find(5);
+  this->s.erase(5);
+  this->s.erase(first);
+  EXPECT_DEATH(static_cast<void>(*middle), "");
+  EXPECT_DEATH(static_cast<void>(*first), "");
+}
+
+TYPED_TEST(GenerationStampDeathTest, ClearedNodesAreStampedDead) {
+  auto it = this->s.find(5);
+  auto last = std::prev(this->s.end());
+  this->s.clear();
+  EXPECT_DEATH(static_cast<void>(*it), "");
+  EXPECT_DEATH(--last, "");
+}
+
+TYPED_TEST(GenerationStampDeathTest, ErasedRangesAreStampedDead) {
+  auto it = this->s.find(5);
+  this->s.erase(this->s.find(3), this->s.find(8));
+  EXPECT_DEATH(static_cast<void>(*it), "");
+}
+
+} // namespace
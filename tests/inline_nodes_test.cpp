@@ -0,0 +1,81 @@
+#include "arena_allocator.h"
+#include "set.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <memory>
+
+// Inline node storage: the first nodes come from slots inside the set, and the slots keep
+// stopping iterators to their elements once those are gone.
+
+namespace {
+
+TEST(InlineNodesTest, AvoidTheAllocator) {
+  struct policy : counted_policy {
+    using storage = inline_nodes<8>;
+  };
+  set<int, std::less<int>, std::allocator<int>, policy> s;
+  for (int i = 0; i < 8; ++i) {
+    s.insert(i);
+  }
+  EXPECT_EQ(s.stats().node_allocations, 0u);
+  s.insert(8);
+  EXPECT_EQ(s.stats().node_allocations, 1u);
+  ASSERT_TRUE(s.validate(validation_level::full));
+}
+
+struct inline_stamp_policy : default_set_policy {
+  using iterators = generation_checked_iterators;
+  using storage = inline_nodes<4>;
+};
+
+// Inline slots are never freed, the stamp written into a slot is all that stops its iterators.
+// The arena set clears by destroying the elements alone, before dropping the arena.
+template <typename Set>
+class InlineStampDeathTest : public ::testing::Test {
+protected:
+  Set s;
+
+  void SetUp() override {
+    for (int i = 0; i < 4; ++i) {
+      s.insert(i);
+    }
+  }
+};
+
+using inline_sets = ::testing::Types<set<int, std::less<int>, std::allocator<int>, inline_stamp_policy>,
+                                     set<int, std::less<int>, arena_allocator<int>, inline_stamp_policy>>;
+
+TYPED_TEST_SUITE(InlineStampDeathTest, inline_sets);
+
+TYPED_TEST(InlineStampDeathTest, UsingAnIteratorToAnErasedElement) {
+  auto it = this->s.find(2);
+  this->s.erase(it);
+  EXPECT_DEATH(static_cast<void>(*it), "");
+}
+
+TYPED_TEST(InlineStampDeathTest, UsingAnIteratorToAnExtractedElement) {
+  auto it = this->s.find(2);
+  auto nh = this->s.extract(it);
+  EXPECT_EQ(nh.value(), 2);
+  EXPECT_DEATH(static_cast<void>(*it), "");
+}
+
+TYPED_TEST(InlineStampDeathTest, UsingAnIteratorAfterClear) {
+  auto first = this->s.begin();
+  auto it = this->s.find(2);
+  this->s.clear();
+  EXPECT_DEATH(static_cast<void>(*it), "");
+  EXPECT_DEATH(++first, "");
+}
+
+TYPED_TEST(InlineStampDeathTest, ReusedSlotsDoNotRevive) {
+  auto it = this->s.find(2);
+  this->s.erase(2);
+  this->s.insert(10);
+  EXPECT_DEATH(static_cast<void>(*it), "");
+}
+
+} // namespace
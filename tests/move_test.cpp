@@ -0,0 +1,107 @@
+#include "set.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+template <typename Config>
+class MoveTest : public set_fixture<Config> {};
+
+TYPED_TEST_SUITE(MoveTest, set_configs);
+
+TYPED_TEST(MoveTest, CopyMoveAndSwap) {
+  using set_type = typename TestFixture::set_type;
+  std::set<int> a_elements{1, 3, 5, 7, 9, 11};
+  std::set<int> b_elements{2, 4};
+  set_type a = this->make(a_elements);
+  set_type b = this->make(b_elements);
+
+  set_type copy(a);
+  this->expect_same(copy, a_elements);
+  copy = b;
+  this->expect_same(copy, b_elements);
+
+  swap(a, b);
+  this->expect_same(a, b_elements);
+  this->expect_same(b, a_elements);
+
+  set_type moved(std::move(b));
+  this->expect_same(moved, a_elements);
+  this->expect_same(b, {});
+
+  a = std::move(moved);
+  this->expect_same(a, a_elements);
+  this->expect_same(moved, {});
+}
+
+// Tracked iterators are re-pointed only on the sides that have some at their elements
+TYPED_TEST(MoveTest, IteratorsFollowTheirElements) {
+  using set_type = typename TestFixture::set_type;
+  using policy = typename TestFixture::policy;
+  if (!TestFixture::is_tracked && !std::is_same_v<typename policy::storage, heap_nodes>) {
+    GTEST_SKIP() << "elements leaving inline slots invalidate their stamped iterators";
+  }
+  set_type a = this->make({1, 3, 5});
+  set_type b = this->make({2, 4});
+  auto five = a.find(5);
+  auto b_end = b.end();
+
+  swap(a, b);
+  this->expect_same(a, {2, 4});
+  this->expect_same(b, {1, 3, 5});
+  EXPECT_TRUE(five == b.find(5));
+  EXPECT_TRUE(b_end == b.end() || b_end == a.end());
+
+  set_type moved(std::move(b));
+  this->expect_same(moved, {1, 3, 5});
+  EXPECT_TRUE(five == moved.find(5));
+  ++five;
+  EXPECT_TRUE(five == moved.end());
+
+  // Only end() iterators are left
+  swap(moved, a);
+  this->expect_same(moved, {2, 4});
+  this->expect_same(a, {1, 3, 5});
+  auto two = moved.begin();
+  a = std::move(moved);
+  this->expect_same(a, {2, 4});
+  EXPECT_EQ(*two, 2);
+  EXPECT_TRUE(two == a.begin());
+  this->expect_same(moved, {});
+}
+
+TYPED_TEST(MoveTest, SelfAssignmentKeepsTheElements) {
+  using set_type = typename TestFixture::set_type;
+  set_type s = this->make({1, 2, 3});
+  set_type& alias = s;
+  s = alias;
+  this->expect_same(s, {1, 2, 3});
+  s = std::move(alias);
+  this->expect_same(s, {1, 2, 3});
+}
+
+// With nothrow moves a growing vector moves its sets instead of copying them
+static_assert(std::is_nothrow_move_constructible_v<set<int>>);
+static_assert(std::is_nothrow_move_assignable_v<set<int>>);
+
+TEST(MoveTest, VectorGrowthMovesTheSets) {
+  std::vector<set<int>> sets(1);
+  for (int i = 0; i < 100; ++i) {
+    sets.front().insert(i);
+  }
+  auto it = sets.front().find(50);
+  for (int i = 0; i < 100; ++i) {
+    sets.emplace_back();
+  }
+  EXPECT_EQ(*it, 50);
+  EXPECT_TRUE(it == sets.front().find(50));
+  EXPECT_TRUE(sets.front().validate(validation_level::full));
+}
+
+} // namespace
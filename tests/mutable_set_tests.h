@@ -0,0 +1,147 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Cases for the containers that invalidate every iterator on a modification, btree_set and
+// flat_set. Their test files instantiate them for their own types.
+
+template <typename Set>
+class MutableSetTest : public ::testing::Test {};
+
+TYPED_TEST_SUITE_P(MutableSetTest);
+
+template <typename T>
+inline T make_key(int i) {
+  if constexpr (std::is_same_v<T, std::string>) {
+    return std::to_string(i);
+  } else {
+    return i;
+  }
+}
+
+TYPED_TEST_P(MutableSetTest, RandomOperationsMatchStdSet) {
+  using value_type = typename TypeParam::value_type;
+  TypeParam s;
+  std::set<value_type> expected;
+  std::mt19937 rng(3);
+  for (int step = 0; step < 20000; ++step) {
+    value_type key = make_key<value_type>(static_cast<int>(rng() % 2000));
+    switch (rng() % 6) {
+    case 0:
+    case 1:
+      ASSERT_EQ(s.insert(key).second, expected.insert(key).second);
+      break;
+    case 2: {
+      auto it = s.insert(s.lower_bound(key), key);
+      expected.insert(key);
+      ASSERT_EQ(*it, key);
+      break;
+    }
+    case 3:
+      ASSERT_EQ(s.erase(key), expected.erase(key));
+      break;
+    case 4: {
+      auto it = s.find(key);
+      ASSERT_EQ(it == s.end(), expected.count(key) == 0);
+      if (it != s.end()) {
+        auto next = s.erase(it);
+        auto expected_next = expected.upper_bound(key);
+        expected.erase(key);
+        ASSERT_EQ(next == s.end(), expected_next == expected.end());
+        if (next != s.end()) {
+          ASSERT_EQ(*next, *expected_next);
+        }
+      }
+      break;
+    }
+    default: {
+      auto lower = s.lower_bound(key);
+      auto upper = s.upper_bound(key);
+      ASSERT_EQ(lower == s.end(), expected.lower_bound(key) == expected.end());
+      ASSERT_EQ(upper == s.end(), expected.upper_bound(key) == expected.end());
+      if (lower != s.end()) {
+        ASSERT_EQ(*lower, *expected.lower_bound(key));
+      }
+      if (upper != s.end()) {
+        ASSERT_EQ(*upper, *expected.upper_bound(key));
+      }
+      ASSERT_EQ(s.contains(key), expected.count(key) == 1);
+      break;
+    }
+    }
+    ASSERT_EQ(s.size(), expected.size());
+  }
+  EXPECT_TRUE(std::equal(s.begin(), s.end(), expected.begin(), expected.end()));
+  EXPECT_TRUE(std::equal(s.rbegin(), s.rend(), expected.rbegin(), expected.rend()));
+
+  TypeParam copy(s);
+  EXPECT_TRUE(std::equal(copy.begin(), copy.end(), expected.begin(), expected.end()));
+  TypeParam moved(std::move(copy));
+  EXPECT_TRUE(copy.empty());
+  EXPECT_TRUE(std::equal(moved.begin(), moved.end(), expected.begin(), expected.end()));
+  s.clear();
+  EXPECT_TRUE(s.empty());
+  EXPECT_TRUE(s.begin() == s.end());
+}
+
+TYPED_TEST_P(MutableSetTest, RangeInsert) {
+  using value_type = typename TypeParam::value_type;
+  std::vector<value_type> keys;
+  std::mt19937 rng(11);
+  for (int i = 0; i < 5000; ++i) {
+    keys.push_back(make_key<value_type>(static_cast<int>(rng() % 3000)));
+  }
+  TypeParam s;
+  s.insert(keys.begin(), keys.begin() + 2500);
+  s.insert(keys.begin() + 2500, keys.end());
+  std::set<value_type> expected(keys.begin(), keys.end());
+  EXPECT_TRUE(std::equal(s.begin(), s.end(), expected.begin(), expected.end()));
+}
+
+REGISTER_TYPED_TEST_SUITE_P(MutableSetTest, RandomOperationsMatchStdSet, RangeInsert);
+
+template <typename Set>
+class InvalidatingSetDeathTest : public ::testing::Test {};
+
+TYPED_TEST_SUITE_P(InvalidatingSetDeathTest);
+
+TYPED_TEST_P(InvalidatingSetDeathTest, AnyInsertionInvalidatesIterators) {
+  TypeParam s;
+  s.insert(1);
+  auto it = s.begin();
+  s.insert(2);
+  EXPECT_DEATH(static_cast<void>(*it), "");
+}
+
+TYPED_TEST_P(InvalidatingSetDeathTest, AnyErasureInvalidatesIterators) {
+  TypeParam s;
+  s.insert(1);
+  s.insert(2);
+  auto it = s.find(1);
+  s.erase(2);
+  EXPECT_DEATH(static_cast<void>(*it), "");
+}
+
+TYPED_TEST_P(InvalidatingSetDeathTest, ClearInvalidatesIterators) {
+  TypeParam s;
+  s.insert(1);
+  auto it = s.begin();
+  s.clear();
+  EXPECT_DEATH(static_cast<void>(*it), "");
+}
+
+TYPED_TEST_P(InvalidatingSetDeathTest, DereferencingEnd) {
+  TypeParam s;
+  s.insert(1);
+  EXPECT_DEATH(static_cast<void>(*s.end()), "");
+}
+
+REGISTER_TYPED_TEST_SUITE_P(InvalidatingSetDeathTest, AnyInsertionInvalidatesIterators,
+                            AnyErasureInvalidatesIterators, ClearInvalidatesIterators, DereferencingEnd);
@@ -0,0 +1,60 @@
+#include "set.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+
+// Pins the node sizes of the table in README.md, "Размер узла". A change of the node layout
+// that breaks this file must update the table too.
+
+namespace {
+
+template <typename Balance, typename Iterators = tracked_iterators, typename Traversal = parent_traversal>
+struct layout : default_set_policy {
+  using balance = Balance;
+  using iterators = Iterators;
+  using traversal = Traversal;
+};
+
+template <typename T, typename Policy>
+constexpr std::size_t node_size = set<T, std::less<T>, std::allocator<T>, Policy>::node_size;
+
+TEST(NodeSizeTest, MatchesTheReadmeTable) {
+#if UINTPTR_MAX == 0xFFFFFFFFFFFFFFFFu
+  static_assert(node_size<char, layout<red_black_balance>> == 40);
+  static_assert(node_size<char, layout<avl_balance>> == 40);
+  static_assert(node_size<char, layout<no_balance>> == 40);
+  static_assert(node_size<int, layout<red_black_balance>> == 40);
+  static_assert(node_size<int, layout<avl_balance>> == 40);
+  static_assert(node_size<int, layout<no_balance>> == 40);
+
+  static_assert(node_size<long, layout<red_black_balance>> == 40);
+  static_assert(node_size<long, layout<avl_balance>> == 48);
+  static_assert(node_size<long, layout<no_balance>> == 40);
+  static_assert(node_size<double, layout<red_black_balance>> == 40);
+  static_assert(node_size<double, layout<avl_balance>> == 48);
+  static_assert(node_size<double, layout<no_balance>> == 40);
+
+  // The string row is for a 32-byte std::string, as in libstdc++
+  static_assert(sizeof(std::string) != 32 || node_size<std::string, layout<red_black_balance>> == 64);
+  static_assert(sizeof(std::string) != 32 || node_size<std::string, layout<avl_balance>> == 72);
+  static_assert(sizeof(std::string) != 32 || node_size<std::string, layout<no_balance>> == 64);
+
+  // unchecked_iterators take 8 bytes off, linked_traversal adds 16
+  static_assert(node_size<int, layout<red_black_balance, unchecked_iterators>> == 32);
+  static_assert(node_size<long, layout<avl_balance, unchecked_iterators>> == 40);
+  static_assert(node_size<int, layout<red_black_balance, tracked_iterators, linked_traversal>> == 56);
+  static_assert(node_size<int, layout<red_black_balance, unchecked_iterators, linked_traversal>> == 48);
+
+  // Generation stamps take the place of the iterator list
+  static_assert(node_size<int, layout<red_black_balance, generation_checked_iterators>> == 40);
+
+  // The default set is the first row
+  static_assert(set<int>::node_size == 40);
+#else
+  GTEST_SKIP() << "the table is for 64-bit targets";
+#endif
+}
+
+} // namespace
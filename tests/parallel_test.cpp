@@ -0,0 +1,172 @@
+#include "parallel_set.h"
+#include "set.h"
+#include "test_support.h"
+#include "thread_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <set>
+#include <stdexcept>
+
+namespace {
+
+struct parallel_policy : default_set_policy {
+  using iterators = unchecked_iterators;
+  using order_statistics = subtree_sizes;
+};
+
+template <typename Set>
+void expect_equal(const Set& s, const std::set<int>& expected) {
+  ASSERT_TRUE(s.validate(validation_level::structure));
+  ASSERT_EQ(s.size(), expected.size());
+  EXPECT_TRUE(std::equal(s.begin(), s.end(), expected.begin(), expected.end()));
+}
+
+template <typename Set>
+class ParallelTest : public ::testing::Test {};
+
+using parallel_sets = ::testing::Types<set<int>, set<int, std::less<int>, std::allocator<int>, parallel_policy>>;
+
+TYPED_TEST_SUITE(ParallelTest, parallel_sets);
+
+// Large enough for the operations to be cut into several parts
+constexpr int parallel_count = 100000;
+
+TYPED_TEST(ParallelTest, CopyMergeAndIntersectMatchTheSequentialOnes) {
+  thread_pool pool(3);
+  TypeParam a;
+  TypeParam b;
+  std::set<int> a_elements = random_contents(a, parallel_count, 4 * parallel_count, 1);
+  std::set<int> b_elements = random_contents(b, parallel_count, 4 * parallel_count, 2);
+
+  TypeParam copy = parallel_copy(a, pool, 4);
+  expect_equal(copy, a_elements);
+
+  std::set<int> both;
+  std::set_intersection(a_elements.begin(), a_elements.end(), b_elements.begin(), b_elements.end(),
+                        std::inserter(both, both.end()));
+  TypeParam intersected(a);
+  parallel_intersect(intersected, b, pool, 4);
+  expect_equal(intersected, both);
+
+  std::set<int> either = a_elements;
+  either.insert(b_elements.begin(), b_elements.end());
+  TypeParam source(b);
+  parallel_merge(copy, source, pool, 4);
+  expect_equal(copy, either);
+  expect_equal(source, both);
+
+  inline_executor here;
+  TypeParam serial(a);
+  parallel_merge(serial, b, here, 4);
+  expect_equal(serial, either);
+}
+
+TYPED_TEST(ParallelTest, DestroyLaterEmptiesTheSet) {
+  TypeParam s;
+  random_contents(s, parallel_count, 4 * parallel_count, 3);
+  {
+    thread_pool reclaimer(1);
+    destroy_later(s, reclaimer);
+    EXPECT_TRUE(s.empty());
+    ASSERT_TRUE(s.validate(validation_level::full));
+    s.insert(1);
+  }
+  expect_equal(s, {1});
+}
+
+// The copying tasks allocate from several threads, so both counters are atomic
+struct allocation_budget {
+  std::atomic<long> live{0};
+  std::atomic<long> remaining{1L << 40};
+};
+
+// Counts the live allocations of all its copies and fails once the allowance runs out
+template <typename T>
+class limited_allocator {
+  template <typename U>
+  friend class limited_allocator;
+
+  std::shared_ptr<allocation_budget> budget_ = std::make_shared<allocation_budget>();
+
+public:
+  using value_type = T;
+
+  limited_allocator() = default;
+
+  template <typename U>
+  limited_allocator(const limited_allocator<U>& other) noexcept : budget_(other.budget_) {}
+
+  T* allocate(std::size_t n) {
+    if (budget_->remaining.fetch_sub(1) <= 0) {
+      throw std::bad_alloc();
+    }
+    T* p = static_cast<T*>(::operator new(n * sizeof(T)));
+    ++budget_->live;
+    return p;
+  }
+
+  void deallocate(T* p, std::size_t) noexcept {
+    --budget_->live;
+    ::operator delete(p);
+  }
+
+  long live() const noexcept {
+    return budget_->live.load();
+  }
+
+  void allow(long allocations) noexcept {
+    budget_->remaining = allocations;
+  }
+
+  template <typename U>
+  bool operator==(const limited_allocator<U>& other) const noexcept {
+    return budget_ == other.budget_;
+  }
+
+  template <typename U>
+  bool operator!=(const limited_allocator<U>& other) const noexcept {
+    return budget_ != other.budget_;
+  }
+};
+
+// Failing in the top levels, which the calling thread copies, or in the tasks below them
+// frees every node the copy took
+TEST(ParallelCopyTest, FailureFreesTheCopiedNodes) {
+  using limited_set = set<int, std::less<int>, limited_allocator<int>, parallel_policy>;
+  limited_allocator<int> alloc;
+  limited_set s(alloc);
+  std::set<int> expected = random_contents(s, parallel_count, 4 * parallel_count, 4);
+  long before = alloc.live();
+  thread_pool pool(3);
+  for (long allowed : {0L, 1L, 2L, 5L, 1000L, 50000L}) {
+    alloc.allow(allowed);
+    EXPECT_THROW(static_cast<void>(parallel_copy(s, pool, 4)), std::bad_alloc);
+    EXPECT_EQ(alloc.live(), before);
+  }
+  alloc.allow(1L << 40);
+  expect_equal(s, expected);
+  expect_equal(parallel_copy(s, pool, 4), expected);
+}
+
+TEST(ThreadPoolTest, RunParallelRethrows) {
+  thread_pool pool(2);
+  std::atomic<int> calls{0};
+  EXPECT_THROW(run_parallel(pool, 8,
+                            [&](std::size_t i) {
+                              ++calls;
+                              if (i == 5) {
+                                throw std::runtime_error("task");
+                              }
+                            }),
+               std::runtime_error);
+  EXPECT_EQ(calls.load(), 8);
+}
+
+} // namespace
@@ -0,0 +1,176 @@
+#include "mapped_set.h"
+#include "set.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+// Trivially copyable without a default constructor, loaded from the binary form
+struct tagged {
+  int key;
+
+  explicit tagged(int k) noexcept : key(k) {}
+
+  friend bool operator<(const tagged& left, const tagged& right) noexcept {
+    return left.key < right.key;
+  }
+};
+
+// A text element whose operator<< writes a space
+struct full_name {
+  std::string first;
+  std::string last;
+
+  friend bool operator<(const full_name& left, const full_name& right) {
+    return std::tie(left.first, left.last) < std::tie(right.first, right.last);
+  }
+
+  friend bool operator==(const full_name& left, const full_name& right) {
+    return left.first == right.first && left.last == right.last;
+  }
+
+  friend std::ostream& operator<<(std::ostream& out, const full_name& name) {
+    return out << name.first << ' ' << name.last;
+  }
+
+  friend std::istream& operator>>(std::istream& in, full_name& name) {
+    return in >> name.first >> name.last;
+  }
+};
+
+template <typename Set>
+Set reload(const Set& s) {
+  std::stringstream stored;
+  s.serialize(stored);
+  Set loaded;
+  loaded.deserialize(stored);
+  EXPECT_FALSE(stored.fail());
+  EXPECT_TRUE(loaded.validate(validation_level::full));
+  return loaded;
+}
+
+TEST(SerializeTest, StringsKeepTheirBoundaries) {
+  const std::vector<std::string> keys = {"", " ", "\n", "a", "a b", "hello world", "line\nbreak", "tab\there",
+                                         "two  spaces ", "zeta", std::string("nul\0byte", 8)};
+  set<std::string> s(keys.begin(), keys.end());
+  ASSERT_EQ(s.size(), keys.size());
+  set<std::string> loaded = reload(s);
+  EXPECT_TRUE(std::equal(loaded.begin(), loaded.end(), s.begin(), s.end()));
+
+  set<std::string> only_empty;
+  only_empty.insert("");
+  EXPECT_EQ(reload(only_empty).size(), 1u);
+  EXPECT_TRUE(reload(set<std::string>()).empty());
+}
+
+TEST(SerializeTest, TextElementsMayContainSpaces) {
+  set<full_name> s;
+  s.insert({"Ada", "Lovelace"});
+  s.insert({"Alan", "Turing"});
+  set<full_name> loaded = reload(s);
+  EXPECT_TRUE(std::equal(loaded.begin(), loaded.end(), s.begin(), s.end()));
+}
+
+TEST(SerializeTest, BinaryElementsNeedNoDefaultConstructor) {
+  set<tagged> s;
+  for (int i = 0; i < 100; ++i) {
+    s.emplace(i * 3);
+  }
+  set<tagged> loaded = reload(s);
+  ASSERT_EQ(loaded.size(), s.size());
+  EXPECT_TRUE(std::equal(loaded.begin(), loaded.end(), s.begin(), s.end(),
+                         [](const tagged& a, const tagged& b) { return a.key == b.key; }));
+}
+
+TEST(SerializeTest, MalformedTextLeavesTheSetUnchanged) {
+  set<std::string> s;
+  s.insert("kept");
+  for (const char* input : {"debugset 2 2\n1 a\n", "debugset 2 1\n5 ab\n", "debugset 2 2\n1 b\n1 a\n",
+                            "debugset 2 1\n1 ab\n", "debugset 1 2\nhello\nworld\n", "debugset 2 1\n99999999999 x"}) {
+    std::istringstream in(input);
+    s.deserialize(in);
+    EXPECT_TRUE(in.fail()) << input;
+    ASSERT_EQ(s.size(), 1u);
+    EXPECT_EQ(*s.begin(), "kept");
+  }
+
+  set<full_name> names;
+  std::istringstream one_word("debugset 2 1\n3 Ada\n");
+  names.deserialize(one_word);
+  EXPECT_TRUE(one_word.fail());
+  std::istringstream three_words("debugset 2 1\n12 Ada B Lovel\n");
+  names.deserialize(three_words);
+  EXPECT_TRUE(three_words.fail());
+  EXPECT_TRUE(names.empty());
+}
+
+TEST(SerializeTest, BinaryRoundTrip) {
+  set<int> s;
+  std::set<int> expected = random_contents(s, 3000, 100000, 4);
+  set<int> loaded = reload(s);
+  EXPECT_TRUE(std::equal(loaded.begin(), loaded.end(), expected.begin(), expected.end()));
+
+  std::stringstream stored;
+  s.serialize(stored);
+  std::string bytes = stored.str();
+  std::istringstream truncated(bytes.substr(0, bytes.size() - 1));
+  set<int> kept;
+  kept.insert(-1);
+  kept.deserialize(truncated);
+  EXPECT_TRUE(truncated.fail());
+  ASSERT_EQ(kept.size(), 1u);
+}
+
+TEST(MappedSetTest, SearchesTheSerializedFile) {
+  set<int> s;
+  std::set<int> expected = random_contents(s, 5000, 20000, 5);
+  std::string path = ::testing::TempDir() + "mapped_set_test." + std::to_string(::getpid());
+  {
+    std::ofstream out(path, std::ios::binary);
+    s.serialize(out);
+    ASSERT_TRUE(out.good());
+  }
+  {
+    mapped_set<int> m(path);
+    expect_lookups(m, expected, 20000);
+    mapped_set<int> moved(std::move(m));
+    EXPECT_TRUE(m.empty());
+    EXPECT_EQ(moved.size(), expected.size());
+  }
+  std::remove(path.c_str());
+  EXPECT_THROW(mapped_set<int>{path}, std::system_error);
+}
+
+TEST(MappedSetTest, RejectsOtherFiles) {
+  std::string path = ::testing::TempDir() + "mapped_set_garbage." + std::to_string(::getpid());
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << std::string(200, 'x');
+  }
+  EXPECT_THROW(mapped_set<int>{path}, std::runtime_error);
+  {
+    set<long> longs;
+    longs.insert(1);
+    std::ofstream out(path, std::ios::binary);
+    longs.serialize(out);
+  }
+  EXPECT_THROW(mapped_set<int>{path}, std::runtime_error);
+  std::remove(path.c_str());
+}
+
+} // namespace
@@ -0,0 +1,68 @@
+#include "set.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+
+namespace {
+
+template <typename Config>
+class SetAlgebraTest : public set_fixture<Config> {};
+
+TYPED_TEST_SUITE(SetAlgebraTest, set_configs);
+
+TYPED_TEST(SetAlgebraTest, SplitAndJoin) {
+  using set_type = typename TestFixture::set_type;
+  std::set<int> elements;
+  for (int i = 0; i < 200; ++i) {
+    elements.insert(this->random_key(1000));
+  }
+  for (int key : {-1, 0, 250, 500, 999, 1000}) {
+    set_type s = this->make(elements);
+    set_type greater;
+    s.split(key, greater);
+    this->expect_same(s, std::set<int>(elements.begin(), elements.lower_bound(key)));
+    this->expect_same(greater, std::set<int>(elements.lower_bound(key), elements.end()));
+    s.join(greater);
+    this->expect_same(s, elements);
+    this->expect_same(greater, {});
+  }
+}
+
+TYPED_TEST(SetAlgebraTest, MergeIntersectSubtract) {
+  using set_type = typename TestFixture::set_type;
+  std::set<int> a_elements;
+  std::set<int> b_elements;
+  for (int i = 0; i < 300; ++i) {
+    a_elements.insert(this->random_key(500));
+    b_elements.insert(this->random_key(500));
+  }
+  std::set<int> both;
+  std::set<int> only_a;
+  std::set<int> either = a_elements;
+  either.insert(b_elements.begin(), b_elements.end());
+  std::set_intersection(a_elements.begin(), a_elements.end(), b_elements.begin(), b_elements.end(),
+                        std::inserter(both, both.end()));
+  std::set_difference(a_elements.begin(), a_elements.end(), b_elements.begin(), b_elements.end(),
+                      std::inserter(only_a, only_a.end()));
+
+  set_type merged = this->make(a_elements);
+  set_type source = this->make(b_elements);
+  merged.merge(source);
+  this->expect_same(merged, either);
+  // The duplicates stay behind
+  this->expect_same(source, both);
+
+  set_type intersected = this->make(a_elements);
+  intersected.intersect(this->make(b_elements));
+  this->expect_same(intersected, both);
+
+  set_type subtracted = this->make(a_elements);
+  subtracted.subtract(this->make(b_elements));
+  this->expect_same(subtracted, only_a);
+}
+
+} // namespace
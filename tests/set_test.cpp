@@ -0,0 +1,115 @@
+#include "set.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+
+namespace {
+
+template <typename Config>
+class SetTest : public set_fixture<Config> {};
+
+TYPED_TEST_SUITE(SetTest, set_configs);
+
+TYPED_TEST(SetTest, RandomOperationsMatchStdSet) {
+  using set_type = typename TestFixture::set_type;
+  set_type s;
+  std::set<int> expected;
+  for (int step = 0; step < 3000; ++step) {
+    int key = this->random_key(300);
+    switch (this->random_key(8)) {
+    case 0:
+    case 1: {
+      auto [it, inserted] = s.insert(key);
+      ASSERT_EQ(inserted, expected.insert(key).second);
+      ASSERT_EQ(*it, key);
+      break;
+    }
+    case 2: {
+      auto hint = s.lower_bound(key);
+      auto it = s.insert(hint, key);
+      expected.insert(key);
+      ASSERT_EQ(*it, key);
+      break;
+    }
+    case 3:
+      ASSERT_EQ(s.erase(key), expected.erase(key));
+      break;
+    case 4: {
+      auto it = s.find(key);
+      auto expected_it = expected.find(key);
+      ASSERT_EQ(it == s.end(), expected_it == expected.end());
+      if (it != s.end()) {
+        auto next = s.erase(it);
+        auto expected_next = expected.erase(expected_it);
+        ASSERT_EQ(next == s.end(), expected_next == expected.end());
+        if (next != s.end()) {
+          ASSERT_EQ(*next, *expected_next);
+        }
+      }
+      break;
+    }
+    case 5: {
+      auto lower = s.lower_bound(key);
+      auto upper = s.upper_bound(key);
+      auto expected_lower = expected.lower_bound(key);
+      auto expected_upper = expected.upper_bound(key);
+      ASSERT_EQ(lower == s.end(), expected_lower == expected.end());
+      ASSERT_EQ(upper == s.end(), expected_upper == expected.end());
+      if (lower != s.end()) {
+        ASSERT_EQ(*lower, *expected_lower);
+      }
+      if (upper != s.end()) {
+        ASSERT_EQ(*upper, *expected_upper);
+      }
+      ASSERT_EQ(s.contains(key), expected.count(key) == 1);
+      ASSERT_EQ(s.count(key), expected.count(key));
+      break;
+    }
+    case 6: {
+      auto nh = s.extract(key);
+      ASSERT_EQ(nh.empty(), expected.count(key) == 0);
+      if (!nh.empty()) {
+        ASSERT_EQ(nh.value(), key);
+        auto result = s.insert(std::move(nh));
+        ASSERT_TRUE(result.inserted);
+        ASSERT_EQ(*result.position, key);
+      }
+      break;
+    }
+    default:
+      s.emplace(key);
+      expected.insert(key);
+      break;
+    }
+    ASSERT_TRUE(s.validate(validation_level::structure));
+    if (step % 500 == 0) {
+      this->expect_same(s, expected);
+    }
+  }
+  this->expect_same(s, expected);
+  s.clear();
+  expected.clear();
+  this->expect_same(s, expected);
+}
+
+TEST(SetTest, StringElements) {
+  set<std::string> s;
+  std::set<std::string> expected;
+  std::mt19937 rng(7);
+  for (int i = 0; i < 500; ++i) {
+    std::string key(1 + rng() % 40, static_cast<char>('a' + rng() % 26));
+    EXPECT_EQ(s.insert(key).second, expected.insert(key).second);
+  }
+  ASSERT_TRUE(s.validate(validation_level::full));
+  EXPECT_TRUE(std::equal(s.begin(), s.end(), expected.begin(), expected.end()));
+  set<std::string> copy(s);
+  EXPECT_TRUE(std::equal(copy.begin(), copy.end(), expected.begin(), expected.end()));
+}
+
+} // namespace
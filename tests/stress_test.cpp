@@ -0,0 +1,48 @@
+#include "set.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+
+// A tree without balancing built from sorted keys is a path as long as the set. Copying,
+// clearing and destroying it must not recurse, or the stack overflows long before 10^7 nodes.
+
+namespace {
+
+struct unbalanced_policy : default_set_policy {
+  using balance = no_balance;
+};
+
+TEST(StressTest, DegenerateTreeOfTenMillionNodes) {
+  constexpr int count = 10'000'000;
+  using path_set = set<int, std::less<int>, std::allocator<int>, unbalanced_policy>;
+  path_set s;
+  // Sorted keys before end() take O(1) each, the search from the root would be O(n)
+  for (int i = 0; i < count; ++i) {
+    s.insert(s.end(), i);
+  }
+  ASSERT_EQ(s.size(), static_cast<std::size_t>(count));
+  EXPECT_EQ(s.height(), static_cast<std::size_t>(count));
+
+  {
+    path_set copy(s);
+    ASSERT_EQ(copy.size(), s.size());
+    EXPECT_EQ(copy.height(), static_cast<std::size_t>(count));
+    EXPECT_EQ(*copy.begin(), 0);
+    EXPECT_EQ(*copy.rbegin(), count - 1);
+    EXPECT_TRUE(copy.contains(count - 1));
+    EXPECT_TRUE(copy.validate(validation_level::path));
+    // The copy is destroyed here, whole
+  }
+
+  s.clear();
+  EXPECT_TRUE(s.empty());
+  EXPECT_TRUE(s.validate(validation_level::full));
+
+  for (int i = 0; i < count; ++i) {
+    s.insert(s.end(), i);
+  }
+  // And destroyed at the end of the test without being cleared first
+}
+
+} // namespace
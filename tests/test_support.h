@@ -0,0 +1,158 @@
+#pragma once
+
+#include "arena_allocator.h"
+#include "set.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <random>
+#include <set>
+#include <type_traits>
+#include <vector>
+
+// The policy matrix and the fixture shared by the typed tests of set. Every test file checks
+// one feature for every configuration, against std::set and validate().
+
+template <typename Balance, typename Iterators, typename Traversal, typename Statistics>
+struct combination : default_set_policy {
+  using balance = Balance;
+  using iterators = Iterators;
+  using traversal = Traversal;
+  using order_statistics = Statistics;
+};
+
+struct counted_policy : default_set_policy {
+  using counters = operation_counters;
+};
+
+struct sampled_policy : default_set_policy {
+  using validation = sampled_validation<16>;
+};
+
+struct inline_policy : default_set_policy {
+  using storage = inline_nodes<4>;
+};
+
+struct inline_generation_policy : default_set_policy {
+  using iterators = generation_checked_iterators;
+  using traversal = linked_traversal;
+  using storage = inline_nodes<8>;
+};
+
+template <typename Policy, typename Allocator = std::allocator<int>>
+struct config {
+  using policy = Policy;
+  using type = set<int, std::less<int>, Allocator, Policy>;
+};
+
+#define DEBUG_SET_TRAVERSALS(B, I)                                                                             \
+  config<combination<B, I, parent_traversal, no_order_statistics>>,                                           \
+      config<combination<B, I, linked_traversal, no_order_statistics>>,                                       \
+      config<combination<B, I, parent_traversal, subtree_sizes>>,                                             \
+      config<combination<B, I, linked_traversal, subtree_sizes>>
+
+#define DEBUG_SET_ITERATORS(B)                                                                                 \
+  DEBUG_SET_TRAVERSALS(B, tracked_iterators), DEBUG_SET_TRAVERSALS(B, unchecked_iterators),                   \
+      DEBUG_SET_TRAVERSALS(B, generation_checked_iterators)
+
+// Every combination of balance, iterators, traversal and order statistics, and the other policy
+// members and the arena separately
+using set_configs = ::testing::Types<DEBUG_SET_ITERATORS(red_black_balance), DEBUG_SET_ITERATORS(avl_balance),
+                                     DEBUG_SET_ITERATORS(no_balance), config<counted_policy>, config<sampled_policy>,
+                                     config<inline_policy>, config<inline_generation_policy>,
+                                     config<default_set_policy, arena_allocator<int>>,
+                                     config<inline_policy, arena_allocator<int>>>;
+
+#undef DEBUG_SET_ITERATORS
+#undef DEBUG_SET_TRAVERSALS
+
+template <typename Config>
+class set_fixture : public ::testing::Test {
+protected:
+  using set_type = typename Config::type;
+  using policy = typename Config::policy;
+
+  static constexpr bool has_order_statistics = std::is_same_v<typename policy::order_statistics, subtree_sizes>;
+  static constexpr bool is_tracked = std::is_same_v<typename policy::iterators, tracked_iterators>;
+
+  std::mt19937 rng{42};
+
+  int random_key(int range) {
+    return std::uniform_int_distribution<int>(0, range - 1)(rng);
+  }
+
+  // Same elements in the same order both ways, and the order statistics agree with them
+  static void expect_same(const set_type& s, const std::set<int>& expected) {
+    ASSERT_TRUE(s.validate(validation_level::full));
+    ASSERT_EQ(s.size(), expected.size());
+    ASSERT_EQ(s.empty(), expected.empty());
+    EXPECT_TRUE(std::equal(s.begin(), s.end(), expected.begin(), expected.end()));
+    EXPECT_TRUE(std::equal(s.rbegin(), s.rend(), expected.rbegin(), expected.rend()));
+    if constexpr (has_order_statistics) {
+      std::size_t i = 0;
+      for (int x : expected) {
+        ASSERT_EQ(*s.nth(i), x);
+        ASSERT_EQ(s.rank(x), i);
+        ++i;
+      }
+      EXPECT_TRUE(s.nth(i) == s.end());
+    }
+  }
+
+  static set_type make(const std::set<int>& elements) {
+    return set_type(elements.begin(), elements.end());
+  }
+};
+
+// Inserts count random keys below range into s and returns them
+template <typename Set>
+std::set<int> random_contents(Set& s, int count, int range, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::set<int> expected;
+  for (int i = 0; i < count; ++i) {
+    int key = static_cast<int>(rng() % range);
+    s.insert(key);
+    expected.insert(key);
+  }
+  return expected;
+}
+
+// Every lookup of a read-only set, one by one and batched, agrees with expected
+template <typename Frozen>
+void expect_lookups(const Frozen& f, const std::set<int>& expected, int range) {
+  ASSERT_EQ(f.size(), expected.size());
+  EXPECT_TRUE(std::equal(f.begin(), f.end(), expected.begin(), expected.end()));
+  EXPECT_TRUE(std::equal(f.rbegin(), f.rend(), expected.rbegin(), expected.rend()));
+  std::vector<int> keys;
+  for (int key = -1; key <= range; ++key) {
+    keys.push_back(key);
+    ASSERT_EQ(f.contains(key), expected.count(key) == 1);
+    auto lower = f.lower_bound(key);
+    auto expected_lower = expected.lower_bound(key);
+    ASSERT_EQ(lower == f.end(), expected_lower == expected.end());
+    if (lower != f.end()) {
+      ASSERT_EQ(*lower, *expected_lower);
+    }
+    auto upper = f.upper_bound(key);
+    auto expected_upper = expected.upper_bound(key);
+    ASSERT_EQ(upper == f.end(), expected_upper == expected.end());
+    if (upper != f.end()) {
+      ASSERT_EQ(*upper, *expected_upper);
+    }
+  }
+  std::vector<char> found(keys.size());
+  std::vector<const int*> bounds(keys.size());
+  f.contains_many(keys.data(), keys.size(), reinterpret_cast<bool*>(found.data()));
+  f.lower_bound_many(keys.data(), keys.size(), bounds.data());
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    ASSERT_EQ(found[i] != 0, expected.count(keys[i]) == 1);
+    auto expected_lower = expected.lower_bound(keys[i]);
+    ASSERT_EQ(bounds[i] == nullptr, expected_lower == expected.end());
+    if (bounds[i]) {
+      ASSERT_EQ(*bounds[i], *expected_lower);
+    }
+  }
+}
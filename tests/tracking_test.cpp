@@ -0,0 +1,110 @@
+#include "set.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+
+#include <utility>
+#include <vector>
+
+// Tracked iterators are linked into the list of their node, so they follow the node between
+// sets and are invalidated with it
+
+namespace {
+
+template <typename Config>
+class TrackedIteratorTest : public set_fixture<Config> {};
+
+using tracked_configs =
+    ::testing::Types<config<combination<red_black_balance, tracked_iterators, parent_traversal, no_order_statistics>>,
+                     config<combination<avl_balance, tracked_iterators, linked_traversal, subtree_sizes>>,
+                     config<combination<no_balance, tracked_iterators, parent_traversal, subtree_sizes>>,
+                     config<inline_policy>, config<default_set_policy, arena_allocator<int>>>;
+
+TYPED_TEST_SUITE(TrackedIteratorTest, tracked_configs);
+
+TYPED_TEST(TrackedIteratorTest, FollowTheirElementsBetweenSets) {
+  using set_type = typename TestFixture::set_type;
+  set_type a = this->make({1, 2, 3, 4, 5, 6});
+  auto it = a.find(2);
+  auto high = a.find(5);
+  set_type b;
+  swap(a, b);
+  EXPECT_EQ(*it, 2);
+  EXPECT_TRUE(it == b.find(2));
+
+  set_type greater;
+  b.split(4, greater);
+  EXPECT_TRUE(high == greater.find(5));
+  b.join(greater);
+  EXPECT_TRUE(high == b.find(5));
+
+  set_type moved(std::move(b));
+  EXPECT_EQ(*it, 2);
+  EXPECT_TRUE(it == moved.find(2));
+  ASSERT_TRUE(moved.validate(validation_level::full));
+}
+
+
+TYPED_TEST(TrackedIteratorTest, ManyIteratorsOnOneNode) {
+  using set_type = typename TestFixture::set_type;
+  set_type s = this->make({1, 2, 3});
+  std::vector<typename set_type::iterator> copies(100, s.find(2));
+  // Unlinked from the middle, the ends and all at once
+  copies.erase(copies.begin() + 50);
+  copies.pop_back();
+  copies.erase(copies.begin());
+  ASSERT_TRUE(s.validate(validation_level::full));
+  auto kept = s.find(2);
+  copies.clear();
+  ASSERT_TRUE(s.validate(validation_level::full));
+  s.erase(1);
+  EXPECT_EQ(*kept, 2);
+  EXPECT_TRUE(kept == s.begin());
+}
+
+TEST(TrackedIteratorDeathTest, ComparingIteratorsOfDifferentSets) {
+  set<int> a;
+  set<int> b;
+  a.insert(1);
+  b.insert(1);
+  EXPECT_DEATH(static_cast<void>(a.begin() == b.begin()), "");
+}
+
+TEST(TrackedIteratorDeathTest, ErasingThroughAnIteratorOfAnotherSet) {
+  set<int> a;
+  set<int> b;
+  a.insert(1);
+  b.insert(1);
+  EXPECT_DEATH(a.erase(b.begin()), "");
+}
+
+TEST(TrackedIteratorDeathTest, UsingAnIteratorOfADestroyedSet) {
+  set<int>::iterator it;
+  {
+    set<int> s;
+    s.insert(1);
+    it = s.begin();
+  }
+  EXPECT_DEATH(static_cast<void>(*it), "");
+}
+
+TEST(TrackedIteratorDeathTest, UsingAMovedFromIterator) {
+  set<int> s;
+  s.insert(1);
+  auto it = s.begin();
+  auto moved = std::move(it);
+  EXPECT_EQ(*moved, 1);
+  EXPECT_DEATH(static_cast<void>(*it), "");
+}
+
+TEST(TrackedIteratorDeathTest, EndOfASwappedSetStaysWithIt) {
+  set<int> a;
+  set<int> b;
+  a.insert(1);
+  auto end = a.end();
+  swap(a, b);
+  EXPECT_TRUE(end == a.end());
+  EXPECT_DEATH(static_cast<void>(end == b.end()), "");
+}
+
+} // namespace
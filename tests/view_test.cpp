@@ -0,0 +1,100 @@
+#include "set.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <vector>
+
+// Views and their cursors are not registered anywhere, the checked modes count the live views
+// of a set and abort on a modification while one exists
+
+namespace {
+
+template <typename Config>
+class ViewTest : public set_fixture<Config> {};
+
+TYPED_TEST_SUITE(ViewTest, set_configs);
+
+TYPED_TEST(ViewTest, ForEachAndViews) {
+  using set_type = typename TestFixture::set_type;
+  std::set<int> elements;
+  for (int i = 0; i < 100; i += 3) {
+    elements.insert(i);
+  }
+  set_type s = this->make(elements);
+  std::vector<int> visited;
+  s.for_each(60, 70, [&](int x) { visited.push_back(x); });
+  EXPECT_EQ(visited, std::vector<int>(elements.lower_bound(60), elements.lower_bound(70)));
+  std::vector<int> viewed;
+  for (int x : s.view(60, 70)) {
+    viewed.push_back(x);
+  }
+  EXPECT_EQ(viewed, visited);
+}
+
+TYPED_TEST(ViewTest, CursorsWalkBothWays) {
+  using set_type = typename TestFixture::set_type;
+  std::set<int> elements;
+  for (int i = 0; i < 300; ++i) {
+    elements.insert(this->random_key(1000));
+  }
+  set_type s = this->make(elements);
+  auto whole = s.view();
+  EXPECT_TRUE(std::equal(whole.begin(), whole.end(), elements.begin(), elements.end()));
+  std::vector<int> backwards;
+  for (auto it = whole.end(); it != whole.begin();) {
+    backwards.push_back(*--it);
+  }
+  EXPECT_TRUE(std::equal(backwards.begin(), backwards.end(), elements.rbegin(), elements.rend()));
+
+  auto empty = s.view(2000, 3000);
+  EXPECT_TRUE(empty.begin() == empty.end());
+  auto copy = whole;
+  EXPECT_EQ(std::distance(copy.begin(), copy.end()), static_cast<std::ptrdiff_t>(elements.size()));
+}
+
+TYPED_TEST(ViewTest, ModificationsResumeAfterTheLastView) {
+  using set_type = typename TestFixture::set_type;
+  set_type s = this->make({1, 2, 3});
+  {
+    auto view = s.view();
+    auto copy = view;
+    EXPECT_EQ(*copy.begin(), 1);
+  }
+  s.insert(4);
+  s.erase(1);
+  this->expect_same(s, {2, 3, 4});
+}
+
+template <typename Set>
+class ViewDeathTest : public ::testing::Test {
+protected:
+  Set s;
+
+  void SetUp() override {
+    for (int i = 0; i < 10; ++i) {
+      s.insert(i);
+    }
+  }
+};
+
+using checked_configs = ::testing::Types<set<int>, config<inline_generation_policy>::type,
+                                         config<combination<avl_balance, generation_checked_iterators,
+                                                            parent_traversal, subtree_sizes>>::type>;
+
+TYPED_TEST_SUITE(ViewDeathTest, checked_configs);
+
+TYPED_TEST(ViewDeathTest, ModifyingUnderAView) {
+  auto view = this->s.view();
+  EXPECT_DEATH(this->s.insert(100), "");
+  EXPECT_DEATH(this->s.erase(1), "");
+}
+
+TYPED_TEST(ViewDeathTest, ForEachCallbackModifyingTheSet) {
+  EXPECT_DEATH(this->s.for_each(0, 10, [this](int x) { this->s.erase(x); }), "");
+}
+
+} // namespace